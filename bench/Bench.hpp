@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+
+namespace reconduit_bench {
+
+// Keeps the compiler from optimizing away a value or the stores behind it.
+template<typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"( value ) : "memory");
+}
+
+// Best time per operation, in nanoseconds, over some runs of f doing ops
+// operations each. The first run warms up caches and pools.
+template<typename F>
+double measure(std::size_t ops, F&& f, int runs = 5)
+{
+    f();
+    auto best = std::chrono::nanoseconds::max();
+    for( auto i = 0; i < runs; ++i ) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min( best, std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ) );
+    }
+    return static_cast<double>( best.count() ) / ops;
+}
+
+// Time per operation of one run of f, for runs which cannot be repeated
+// (e.g. filling a table).
+template<typename F>
+double measureOnce(std::size_t ops, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start );
+    return static_cast<double>( elapsed.count() ) / ops;
+}
+
+inline void report(const char* name, double ns_per_op)
+{
+    std::printf("%-48s %10.2f ns/op\n", name, ns_per_op);
+}
+
+}
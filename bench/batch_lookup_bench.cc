@@ -0,0 +1,106 @@
+#include "Bench.hpp"
+#include "FlatFlowTable.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+// Lookups of bursts of packets into a table of 10M flows (or argv[1] flows),
+// one find() per packet against one find_many() per burst, which hashes the
+// whole burst and prefetches the home slots of every flow before resolving
+// any. Packets either only look their flow up, or also go through some work
+// of their own between lookups, as in a mux, which keeps the CPU from
+// overlapping the misses of consecutive lookups by itself.
+
+namespace reconduit_bench {
+
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+struct Context
+{
+    void*         next_conduit;
+    std::uint64_t state;
+};
+
+using Flat = reconduits::FlatFlowTable<flow_key, Context>;
+
+// Stands for the per packet work of a mux between two lookups.
+inline std::uint64_t work(std::uint64_t x, int rounds)
+{
+    for( auto i = 0; i < rounds; ++i ) x = x * 0x9e3779b97f4a7c15ull + ( x >> 17 );
+    return x;
+}
+
+// One find() per packet, followed by the work of the packet.
+inline double runOneByOne(Flat& table, const std::vector<flow_key>& packets, std::size_t burst, int rounds)
+{
+    std::uint64_t sum{};
+    auto ns = measure(packets.size(), [ & ]
+    {
+        for( auto first = std::size_t{}; first + burst <= packets.size(); first += burst ) {
+            for( auto i = first; i < first + burst; ++i ) {
+                if( auto ctx = table.find( packets[ i ] ) ) sum += work( ++ctx->state, rounds );
+            }
+        }
+    });
+    doNotOptimize( sum );
+    return ns;
+}
+
+// One find_many() per burst, followed by the work of every packet.
+inline double runFindMany(Flat& table, const std::vector<flow_key>& packets, std::size_t burst, int rounds)
+{
+    std::vector<Context*> found( burst );
+    std::uint64_t sum{};
+    auto ns = measure(packets.size(), [ & ]
+    {
+        for( auto first = std::size_t{}; first + burst <= packets.size(); first += burst ) {
+            table.find_many( packets.data() + first, burst, found.data() );
+            for( auto ctx : found ) {
+                if( ctx ) sum += work( ++ctx->state, rounds );
+            }
+        }
+    });
+    doNotOptimize( sum );
+    return ns;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace reconduit_bench;
+
+    auto flows = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 10'000'000ull;
+
+    std::mt19937_64 random{ 42 };
+    std::vector<flow_key> keys( flows );
+    for( auto& k : keys ) {
+        auto r = random();
+        k = flow_key{ static_cast<std::uint32_t>( r ), static_cast<std::uint32_t>( r >> 32 ),
+                      static_cast<std::uint16_t>( random() ), 443 };
+    }
+    auto table = new Flat{};
+    table->reserve( flows );
+    for( auto& k : keys ) table->try_emplace( k, nullptr, std::uint64_t{ 1 } );
+
+    // Packets of random flows, every flow once.
+    auto packets = keys;
+    std::shuffle( packets.begin(), packets.end(), random );
+
+    for( auto rounds : { 0, 20 } ) {
+        for( auto burst : { std::size_t{ 16 }, std::size_t{ 64 } } ) {
+            char label[ 96 ];
+            std::snprintf(label, sizeof( label ), "%llu flows, burst %zu, work %d, find", flows, burst, rounds);
+            report(label, runOneByOne( *table, packets, burst, rounds ));
+            std::snprintf(label, sizeof( label ), "%llu flows, burst %zu, work %d, find_many", flows, burst, rounds);
+            report(label, runFindMany( *table, packets, burst, rounds ));
+        }
+    }
+    delete table;
+}
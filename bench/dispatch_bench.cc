@@ -0,0 +1,110 @@
+#include "Bench.hpp"
+#include "ReConduitVisitors.hpp"
+
+#include <variant>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+// Conduit x message double dispatch through each back-end, for a type list the
+// size of a real deployment (16 user conduits, 4 message kinds) and a short
+// one (4 x 4), with random pairs so that the branch predictor cannot learn them.
+
+namespace reconduit_bench {
+
+// Every pair does something slightly different, as real conduits do, so the
+// compiler cannot fold the dispatch away.
+template<int N>
+struct UserConduit
+{
+    static constexpr std::uint64_t weight = 2 * N + 3;
+    std::uint64_t seen;
+};
+
+template<int N>
+struct Kind
+{
+    static constexpr unsigned shift = N + 1;
+    std::uint64_t payload;
+};
+
+template<typename Is>
+struct user_conduits;
+
+template<int... I>
+struct user_conduits<std::integer_sequence<int, I...>>
+{
+    using type = std::variant<UserConduit<I>*...>;
+    static constexpr auto size = sizeof...(I);
+};
+
+using message = std::variant<Kind<0>, Kind<1>, Kind<2>, Kind<3>>;
+
+template<int N>
+struct Workload
+{
+    using conduits = user_conduits<std::make_integer_sequence<int, N>>;
+    using conduit  = typename conduits::type;
+
+    static constexpr std::size_t pairs = 1 << 16;
+
+    Workload()
+    {
+        make( std::make_integer_sequence<int, N>{} );
+        std::mt19937 random{ 42 };
+        for( auto i = 0u; i < pairs; ++i ) {
+            conduit_.push_back( pool_[ random() % N ] );
+            message_.push_back( kinds_[ random() % 4 ] );
+        }
+    }
+
+    template<int... I>
+    void make(std::integer_sequence<int, I...>)
+    {
+        ( pool_.push_back( conduit{ new UserConduit<I>{} } ), ... );
+    }
+
+    template<typename D>
+    double run(D&& double_dispatch)
+    {
+        auto accept = [](auto&& conduit_ptr, auto&& msg)
+        {
+            using C = std::decay_t<decltype(*conduit_ptr)>;
+            using K = std::decay_t<decltype(msg)>;
+            conduit_ptr->seen = conduit_ptr->seen * C::weight + ( msg.payload << K::shift );
+            return conduit_ptr->seen;
+        };
+        constexpr auto rounds = 16u;
+        return measure(rounds * pairs, [ & ] {
+            std::uint64_t sum{};
+            for( auto r = 0u; r < rounds; ++r ) {
+                for( auto i = 0u; i < pairs; ++i ) sum += double_dispatch( conduit_[ i ], message_[ i ], accept );
+            }
+            doNotOptimize( sum );
+        });
+    }
+
+    std::vector<conduit> pool_;
+    std::vector<conduit> conduit_;
+    std::vector<message> message_;
+    const message kinds_[ 4 ] = { Kind<0>{ 1 }, Kind<1>{ 2 }, Kind<2>{ 3 }, Kind<3>{ 4 } };
+};
+
+template<int N>
+void compare(const char* visit, const char* table, const char* sw)
+{
+    using namespace reconduits;
+    Workload<N> workload;
+    report(visit, workload.run( [](auto v, auto m, auto&& f) { return visitDoubleDispatch_r(v, m, f); } ));
+    report(table, workload.run( [](auto v, auto m, auto&& f) { return tableDoubleDispatch_r(v, m, f); } ));
+    report(sw,    workload.run( [](auto v, auto m, auto&& f) { return switchDoubleDispatch_r(v, m, f); } ));
+}
+
+}
+
+int main()
+{
+    using namespace reconduit_bench;
+    compare<16>("16 x 4, nested std::visit", "16 x 4, flat table", "16 x 4, switch");
+    compare<4>("4 x 4, nested std::visit", "4 x 4, flat table", "4 x 4, switch");
+}
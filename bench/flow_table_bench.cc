@@ -0,0 +1,108 @@
+#include "Bench.hpp"
+#include "FlatFlowTable.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+// Flow tables at 1M and 10M flows (or argv[1..] flows): the node based map
+// L4Mux used, with its XOR of the 4-tuple fields and with FlowHash, against
+// FlatFlowTable. Lookups hit in random order, misses look for the reversed
+// flows, which the XOR hash maps to the same buckets.
+
+namespace reconduit_bench {
+
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+struct Context
+{
+    void*         next_conduit;
+    std::uint64_t state;
+};
+
+struct XorHash
+{
+    std::size_t operator()(const flow_key& k) const noexcept
+    {
+        return std::get<0>( k ) ^ std::get<1>( k ) ^ std::get<2>( k ) ^ std::get<3>( k );
+    }
+};
+
+using XorMap  = std::unordered_map<flow_key, Context, XorHash>;
+using HashMap = std::unordered_map<flow_key, Context, reconduits::FlowHash<flow_key>>;
+using Flat    = reconduits::FlatFlowTable<flow_key, Context>;
+
+inline Context* findIn(XorMap& m, const flow_key& k)  { auto it = m.find( k ); return it != m.end() ? &it->second : nullptr; }
+inline Context* findIn(HashMap& m, const flow_key& k) { auto it = m.find( k ); return it != m.end() ? &it->second : nullptr; }
+inline Context* findIn(Flat& t, const flow_key& k)    { return t.find( k ); }
+
+inline void insertIn(XorMap& m, const flow_key& k)  { m.emplace( k, Context{ nullptr, 1 } ); }
+inline void insertIn(HashMap& m, const flow_key& k) { m.emplace( k, Context{ nullptr, 1 } ); }
+inline void insertIn(Flat& t, const flow_key& k)    { t.try_emplace( k, nullptr, std::uint64_t{ 1 } ); }
+
+template<typename Table>
+void run(const char* name, const std::vector<flow_key>& flows, const std::vector<flow_key>& lookups, const std::vector<flow_key>& misses)
+{
+    auto n = flows.size();
+    auto table = new Table{};
+    auto insert = measureOnce(n, [ & ] { for( auto& k : flows ) insertIn( *table, k ); });
+
+    std::uint64_t found{};
+    auto hit = measure(n, [ & ] { for( auto& k : lookups ) found += findIn( *table, k ) != nullptr; }, 2);
+    auto miss = measure(n, [ & ] { for( auto& k : misses ) found += findIn( *table, k ) != nullptr; }, 2);
+    doNotOptimize( found );
+
+    auto erase = measureOnce(n, [ & ] { for( auto& k : lookups ) table->erase( k ); });
+    delete table;
+
+    auto line = [ & ](const char* op, double ns)
+    {
+        char label[ 96 ];
+        std::snprintf(label, sizeof( label ), "%zu flows, %s %s", n, name, op);
+        report(label, ns);
+    };
+    line("insert", insert);
+    line("lookup hit", hit);
+    line("lookup miss", miss);
+    line("erase", erase);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace reconduit_bench;
+
+    std::vector<std::size_t> sizes{ 1'000'000, 10'000'000 };
+    if( argc > 1 ) sizes.clear();
+    for( auto i = 1; i < argc; ++i ) sizes.push_back( std::strtoull( argv[ i ], nullptr, 10 ) );
+
+    std::mt19937_64 random{ 42 };
+    for( auto n : sizes ) {
+        // Clients of a few servers, as seen by a probe: addresses and ports
+        // share most of their bits.
+        std::vector<flow_key> flows( n ), misses( n );
+        for( auto& k : flows ) {
+            auto r = random();
+            k = flow_key{ 0x0a000000u | std::uint32_t( r & 0xfffff ), 0xc0a80000u | std::uint32_t( ( r >> 20 ) & 0xff ),
+                          std::uint16_t( 1024 + ( ( r >> 28 ) % 60000 ) ), std::uint16_t( r >> 44 & 1 ? 443 : 80 ) };
+        }
+        for( auto i = std::size_t{}; i < n; ++i ) {
+            auto& [ src, dst, sport, dport ] = flows[ i ];
+            misses[ i ] = flow_key{ dst, src, dport, sport };
+        }
+        auto lookups = flows;
+        std::shuffle( lookups.begin(), lookups.end(), random );
+
+        run<XorMap>("unordered_map xor hash", flows, lookups, misses);
+        run<HashMap>("unordered_map FlowHash", flows, lookups, misses);
+        run<Flat>("FlatFlowTable", flows, lookups, misses);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "Bench.hpp"
+#include "FlatFlowTable.hpp"
+
+#include <unordered_map>
+#include <memory_resource>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <tuple>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+// Flows inserted one after the other, 8M by default (or argv[1]), timing
+// every insertion: the tail is made of the insertions which grow the table.
+// Peak memory is that of the table, counted by its memory resource.
+
+namespace reconduit_bench {
+
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+struct Context
+{
+    void*         next_conduit;
+    std::uint64_t state;
+};
+
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+
+    std::size_t peak() const noexcept { return peak_; }
+
+private:
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        peak_ = std::max( peak_, current_ += bytes );
+        return std::pmr::new_delete_resource()->allocate( bytes, alignment );
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        current_ -= bytes;
+        std::pmr::new_delete_resource()->deallocate( p, bytes, alignment );
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::size_t current_{};
+    std::size_t peak_{};
+};
+
+using Map         = std::pmr::unordered_map<flow_key, Context, reconduits::FlowHash<flow_key>>;
+using OneShot     = reconduits::FlatFlowTable<flow_key, Context>;
+using Incremental = reconduits::FlatFlowTable<flow_key, Context, reconduits::FlowHash<flow_key>,
+                                              std::equal_to<flow_key>, reconduits::IncrementalRehash<>>;
+
+inline void insertIn(Map& m, const flow_key& k)         { m.emplace( k, Context{ nullptr, 1 } ); }
+inline void insertIn(OneShot& t, const flow_key& k)     { t.try_emplace( k, nullptr, std::uint64_t{ 1 } ); }
+inline void insertIn(Incremental& t, const flow_key& k) { t.try_emplace( k, nullptr, std::uint64_t{ 1 } ); }
+
+template<typename Table>
+void run(const char* name, const std::vector<flow_key>& flows)
+{
+    CountingResource resource;
+    std::vector<std::uint32_t> latencies( flows.size() );
+    {
+        Table table{ &resource };
+        auto start = std::chrono::steady_clock::now();
+        for( auto i = std::size_t{}; i < flows.size(); ++i ) {
+            insertIn( table, flows[ i ] );
+            auto now = std::chrono::steady_clock::now();
+            latencies[ i ] = static_cast<std::uint32_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( now - start ).count() );
+            start = now;
+        }
+        doNotOptimize( table );
+    }
+    std::sort( latencies.begin(), latencies.end() );
+    auto at = [ & ](double q) { return latencies[ static_cast<std::size_t>( q * ( latencies.size() - 1 ) ) ]; };
+    std::printf("%-28s p50 %6u  p99 %6u  p99.9 %6u  max %10u ns  peak %7.1f MB\n",
+                name, at( 0.5 ), at( 0.99 ), at( 0.999 ), latencies.back(), resource.peak() / 1048576.0);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace reconduit_bench;
+
+    std::size_t n = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : 8'000'000;
+
+    std::mt19937_64 random{ 42 };
+    std::vector<flow_key> flows( n );
+    for( auto& k : flows ) {
+        auto r = random();
+        k = flow_key{ std::uint32_t( r ), std::uint32_t( r >> 32 ), std::uint16_t( random() ), 443 };
+    }
+
+    std::printf("%zu flows inserted\n", n);
+    run<Map>("unordered_map", flows);
+    run<OneShot>("FlatFlowTable one shot", flows);
+    run<Incremental>("FlatFlowTable incremental", flows);
+    return 0;
+}
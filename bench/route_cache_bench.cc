@@ -0,0 +1,102 @@
+#include "Bench.hpp"
+#include "FlatFlowTable.hpp"
+#include "RouteCache.hpp"
+
+#include <algorithm>
+#include <random>
+#include <tuple>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+// Packets of random flows looked up in a FlatFlowTable, as muxes with a mux
+// table do, against a RouteCache tried first and the table on a miss, as the
+// Mux conduit does for muxes giving flow keys. The cache learns the route of
+// a flow on its first miss and grows with flows, so its hit rate is that of a
+// direct mapped cache about as large as the number of flows.
+
+namespace reconduit_bench {
+
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+struct Context
+{
+    reconduits::Conduit* next_conduit;
+    std::uint64_t        state;
+};
+
+using Flat  = reconduits::FlatFlowTable<flow_key, Context>;
+using Cache = reconduits::RouteCache<flow_key>;
+
+inline reconduits::Conduit* conduitOf(std::size_t i) { return reinterpret_cast<reconduits::Conduit*>( ( i + 1 ) * 64 ); }
+
+inline double runTable(Flat& table, const std::vector<flow_key>& packets)
+{
+    std::uintptr_t sum{};
+    auto ns = measure(packets.size(), [ & ]
+    {
+        for( auto& k : packets ) {
+            if( auto ctx = table.find( k ) ) sum += reinterpret_cast<std::uintptr_t>( ctx->next_conduit );
+        }
+    });
+    doNotOptimize( sum );
+    return ns;
+}
+
+inline double runCache(Cache& cache, Flat& table, const std::vector<flow_key>& packets, std::size_t& hits)
+{
+    std::uintptr_t sum{};
+    auto ns = measure(packets.size(), [ & ]
+    {
+        hits = 0;
+        for( auto& k : packets ) {
+            if( auto next = cache.find( k ) ) {
+                ++hits;
+                sum += reinterpret_cast<std::uintptr_t>( next );
+            } else if( auto ctx = table.find( k ) ) {
+                cache.insert(k, ctx->next_conduit);
+                sum += reinterpret_cast<std::uintptr_t>( ctx->next_conduit );
+            }
+        }
+    });
+    doNotOptimize( sum );
+    return ns;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace reconduit_bench;
+
+    auto max_flows = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 4'000'000ull;
+
+    std::mt19937_64 random{ 42 };
+    for( auto flows = 1'000ull; flows <= max_flows; flows *= 8 ) {
+        std::vector<flow_key> keys( flows );
+        for( auto& k : keys ) {
+            auto r = random();
+            k = flow_key{ static_cast<std::uint32_t>( r ), static_cast<std::uint32_t>( r >> 32 ),
+                          static_cast<std::uint16_t>( random() ), 443 };
+        }
+        auto table = new Flat{};
+        table->reserve( flows );
+        for( auto i = std::size_t{}; i < flows; ++i ) table->try_emplace( keys[ i ], conduitOf( i ), std::uint64_t{} );
+
+        // Every flow about 8 times, in random order.
+        std::vector<flow_key> packets;
+        packets.reserve( std::max( flows * 8, 1'000'000ull ) );
+        while( packets.size() < packets.capacity() ) packets.push_back( keys[ random() % flows ] );
+
+        Cache cache;
+        std::size_t hits{};
+        char label[ 96 ];
+        std::snprintf(label, sizeof( label ), "%llu flows, table", flows);
+        report(label, runTable( *table, packets ));
+        std::snprintf(label, sizeof( label ), "%llu flows, route cache then table", flows);
+        report(label, runCache( cache, *table, packets, hits ));
+        std::printf("%-48s %10.1f %% (%zu entries)\n", "  route cache hits", 100.0 * hits / packets.size(), cache.capacity());
+        delete table;
+    }
+}
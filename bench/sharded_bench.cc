@@ -0,0 +1,119 @@
+#include "Bench.hpp"
+#include "ReConduitTypesGenerators.hpp"
+#include "ShardedRuntime.hpp"
+
+#include <memory>
+#include <thread>
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include <cstdint>
+
+// Synthetic traffic of many flows through one replica of a small graph per
+// shard, from 1 shard up to the number of cores (or argv[1] shards). Every
+// message costs about the same work, so throughput should scale with shards
+// as long as the feeding thread keeps up.
+
+namespace reconduit_bench {
+
+struct Frame
+{
+    std::uint64_t flow;
+    std::uint64_t value;
+};
+
+// Stands for parsing and classification work.
+struct Work
+{
+    auto accept(auto&& msg, reconduits::Conduit*)
+    {
+        auto& frame = msg.get();
+        for( auto i = 0; i < 256; ++i ) frame.value = ( frame.value ^ frame.flow ) * 0x9e3779b97f4a7c15ull + i;
+        return std::pair{ reconduits::NextSide::b, make_variant_message( msg ) };
+    }
+};
+
+struct Sink
+{
+    std::uint64_t* sum_;
+
+    auto accept(auto&& msg)
+    {
+        *sum_ += msg.get().value;
+        return std::pair{ reconduits::NextSide::done, make_variant_message( msg ) };
+    }
+};
+
+struct NullMux
+{
+    auto accept(auto&& msg, reconduits::Conduit*) { return std::pair{ reconduits::NextSide::done, make_variant_message( msg ) }; }
+    auto find(auto&&) const { return std::pair{ static_cast<reconduits::Conduit*>( nullptr ), false }; }
+    reconduits::Conduit* insert(auto&&, reconduits::Conduit&) { return nullptr; }
+    reconduits::Conduit* erase(auto&&) { return nullptr; }
+    auto setup(auto&& msg, reconduits::Conduit* origin) const { return make_variant_setup_message(msg, origin); }
+};
+
+struct NullFactory
+{
+    reconduits::Conduit* accept(auto&&, reconduits::Conduit*, reconduits::Conduit*) { return nullptr; }
+};
+
+}
+
+GENERATE_ADAPTER_CONDUITS(  reconduit_bench::Sink );
+GENERATE_FACTORY_CONDUITS(  reconduit_bench::NullFactory );
+GENERATE_MUX_CONDUITS(      reconduit_bench::NullMux );
+GENERATE_PROTOCOL_CONDUITS( reconduit_bench::Work );
+
+#include "ReConduitTypes.hpp"
+
+namespace reconduit_bench {
+
+struct Graph
+{
+    Graph() { work_.setSideB( sink_ ); }
+
+    reconduits::Conduit& entry() noexcept { return work_; }
+
+    std::uint64_t sum_{};
+    reconduits::Conduit sink_{ reconduits::Adapter{ Sink{ &sum_ } } };
+    reconduits::Conduit work_{ reconduits::Protocol{ Work{} } };
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace reconduits;
+    using namespace reconduit_bench;
+
+    constexpr std::size_t messages = 200'000;
+    constexpr std::uint64_t flows  = 4096;
+
+    auto cores = std::max( 1u, std::thread::hardware_concurrency() );
+    std::size_t max_shards = argc > 1 ? std::strtoul( argv[ 1 ], nullptr, 10 ) : cores;
+
+    std::vector<std::size_t> counts;
+    for( auto shards = std::size_t{ 1 }; shards < max_shards; shards *= 2 ) counts.push_back( shards );
+    counts.push_back( max_shards );
+
+    double single{};
+    for( auto shards : counts ) {
+        auto runtime = makeShardedRuntime<Frame>(shards,
+                [](std::size_t) { return std::make_unique<Graph>(); },
+                [](const Frame& f) { return FlowHash<std::uint64_t>{}( f.flow ); });
+        auto ns = measure(messages, [ & ] {
+            for( auto i = std::uint64_t{}; i < messages; ++i ) {
+                Frame frame{ ( i * 2654435761u ) % flows, i };
+                runtime->accept( InformationChunk<Frame>{ frame } );
+            }
+            runtime->flush();
+        }, 3);
+        if( shards == 1 ) single = ns;
+        char name[ 64 ];
+        std::snprintf(name, sizeof( name ), "%zu shards on %u cores, x%.2f", shards, cores, single / ns);
+        report(name, ns);
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "Bench.hpp"
+#include "ReConduitTypesGenerators.hpp"
+#include "StaticChain.hpp"
+
+#include <utility>
+#include <cstdint>
+
+// Fixed chains of protocols, either as one Conduit per protocol or fused in a
+// StaticChain, between a source and an adapter sinking the messages.
+
+namespace reconduit_bench {
+
+struct Frame
+{
+    std::uint64_t hops;
+};
+
+template<int N>
+struct Stage
+{
+    constexpr auto accept(auto&& msg, reconduits::Conduit*)
+    {
+        ++msg.get().hops;
+        return std::pair{ reconduits::NextSide::b, make_variant_message( msg ) };
+    }
+};
+
+struct Sink
+{
+    constexpr auto accept(auto&& msg)
+    {
+        return std::pair{ reconduits::NextSide::done, make_variant_message( msg ) };
+    }
+};
+
+struct NullMux
+{
+    auto accept(auto&& msg, reconduits::Conduit*) { return std::pair{ reconduits::NextSide::done, make_variant_message( msg ) }; }
+    auto find(auto&&) const { return std::pair{ static_cast<reconduits::Conduit*>( nullptr ), false }; }
+    reconduits::Conduit* insert(auto&&, reconduits::Conduit&) { return nullptr; }
+    reconduits::Conduit* erase(auto&&) { return nullptr; }
+    auto setup(auto&& msg, reconduits::Conduit* origin) const { return make_variant_setup_message(msg, origin); }
+};
+
+struct NullFactory
+{
+    reconduits::Conduit* accept(auto&&, reconduits::Conduit*, reconduits::Conduit*) { return nullptr; }
+};
+
+using Chain = reconduits::StaticChain<Stage<0>, Stage<1>, Stage<2>, Stage<3>>;
+
+}
+
+GENERATE_ADAPTER_CONDUITS(  reconduit_bench::Sink );
+GENERATE_FACTORY_CONDUITS(  reconduit_bench::NullFactory );
+GENERATE_MUX_CONDUITS(      reconduit_bench::NullMux );
+GENERATE_PROTOCOL_CONDUITS( reconduit_bench::Stage<0>, reconduit_bench::Stage<1>, reconduit_bench::Stage<2>, \
+                            reconduit_bench::Stage<3>, reconduit_bench::Chain );
+
+#include "ReConduitTypes.hpp"
+
+int main()
+{
+    using namespace reconduits;
+    using namespace reconduit_bench;
+
+    constexpr std::size_t messages = 1'000'000;
+    constexpr std::size_t stages   = Chain::size();
+
+    Conduit sink{ Adapter{ Sink{} } };
+
+    Conduit stage0{ Protocol{ Stage<0>{} } };
+    Conduit stage1{ Protocol{ Stage<1>{} } };
+    Conduit stage2{ Protocol{ Stage<2>{} } };
+    Conduit stage3{ Protocol{ Stage<3>{} } };
+    stage0.setSideB( stage1 );
+    stage1.setSideB( stage2 );
+    stage2.setSideB( stage3 );
+    stage3.setSideB( sink );
+
+    Conduit chain{ Protocol{ Chain{} } };
+    chain.setSideB( sink );
+
+    Frame frame{};
+    auto run = [ & ](Conduit& first)
+    {
+        return measure(messages, [ & ] {
+            for( auto i = 0u; i < messages; ++i ) first.accept( InformationChunk<Frame>{ frame } );
+            doNotOptimize( frame );
+        });
+    };
+
+    auto connected = run( stage0 );
+    auto fused     = run( chain );
+
+    report("4 protocols, one Conduit each", connected);
+    report("4 protocols, one StaticChain", fused);
+    report("saving per fused hop", ( connected - fused ) / ( stages - 1 ));
+    return frame.hops ? 0 : 1;
+}
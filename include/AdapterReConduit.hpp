@@ -3,6 +3,8 @@
 
 #include "ReConduitVisitors.hpp"
 #include "ReConduitPool.hpp"
+#include "BatchMessage.hpp"
+#include "ReConduitFwd.hpp"
 
 #include <type_traits>
 
@@ -17,7 +19,16 @@ public:
     template<typename T, typename = std::enable_if_t< ! std::is_same_v<std::decay_t<T>, Adapter> > >
     Adapter(T&& a)
         : conduit_to_side_a_{}
-        , adapter_{ new ( getFromPool<sizeof(T)>() ) T{ std::forward<T>( a ) } }
+        , adapter_{ new ( getFromPool<sizeof(T), alignof(T)>() ) T{ std::forward<T>( a ) } }
+    {
+        SPDLOG_DEBUG(getLogger(), "New Adapter Conduit [{0:p}] created", static_cast<void*>(this));
+    }
+
+    // Adopts a user object already placed by its Conduit.
+    template<typename T>
+    explicit Adapter(PlacedUser<T> placed)
+        : conduit_to_side_a_{}
+        , adapter_{ placed.user_ }
     {
         SPDLOG_DEBUG(getLogger(), "New Adapter Conduit [{0:p}] created", static_cast<void*>(this));
     }
@@ -43,7 +54,7 @@ public:
             if( adapter_ptr ) {
                 using T = std::decay_t<decltype( *adapter_ptr )>;
                 adapter_ptr->~T();
-                putToPool<sizeof(T)>( adapter_ptr );
+                putToPool<sizeof(T), alignof(T)>( adapter_ptr );
             }
         };
         dispatch(adapter_, delete_adapter);
@@ -57,16 +68,18 @@ private:
 
     friend Conduit;
 
+    constexpr auto& user() noexcept { return adapter_; }
+
     constexpr void setSideA(Conduit& a) noexcept { conduit_to_side_a_ = &a; }
     constexpr void setSideB(Conduit&  ) noexcept {}
 
-    constexpr auto accept(auto&& v_msg, Conduit* ctx_conduit)
+    constexpr auto accept(auto v_msg, Conduit* ctx_conduit)
     {
         SPDLOG_DEBUG(getLogger(), "Adapter Conduit [{:p}] with [a] -> [{:p}] accepts a new message.",
                 static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_));
-        auto accept = [](auto&& adapter_ptr, auto&& msg_ptr)
+        auto accept = [](auto&& adapter_ptr, auto&& msg)
         {
-            return adapter_ptr->accept( *msg_ptr );
+            return adapter_ptr->accept( msg );
         };
         auto [ next, next_v_msg ] = doubleDispatch_r(adapter_, v_msg, accept);
         return next == NextSide::a ?
@@ -74,6 +87,26 @@ private:
             std::pair{ static_cast<Conduit*>( nullptr ), v_msg };
     }
 
+    constexpr auto acceptBatch(auto batch, Conduit* ctx_conduit)
+    {
+        SPDLOG_DEBUG(getLogger(), "Adapter Conduit [{:p}] with [a] -> [{:p}] accepts a batch of {} messages.",
+                static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), batch.size());
+        auto accept = [ & ](auto&& adapter_ptr)
+        {
+            using T = std::decay_t<decltype(*adapter_ptr)>;
+            if constexpr ( has_batch_accept<T, decltype(batch)>::value ) {
+                auto [ next, next_batch ] = adapter_ptr->acceptBatch( batch );
+                return next == NextSide::a ?
+                    std::pair{ conduit_to_side_a_, next_batch } :
+                    std::pair{ static_cast<Conduit*>( nullptr ), next_batch };
+            } else {
+                ctx_conduit->acceptEach( batch );
+                return std::pair{ static_cast<Conduit*>( nullptr ), batch };
+            }
+        };
+        return dispatch_r(adapter_, accept);
+    }
+
     Conduit* conduit_to_side_a_;
     adapter_type adapter_;
 };
@@ -18,20 +18,7 @@ public:
         , conduit_origin_{ c }
     {}
 
-    static void* operator new(std::size_t sz)
-    {
-        return getFromPool<sizeof(Alerting)>();
-    }
-
-    static void* operator new(std::size_t sz, Alerting* p)
-    {
-        return ::operator new(sz, p);
-    }
-
-    static void operator delete(void* p)
-    {
-        putToPool<sizeof(Alerting)>( p );
-    }
+    auto getOrigin() const { return conduit_origin_; }
 
 private:
 
@@ -0,0 +1,210 @@
+#ifndef __ASYNC_BOUNDARY_RECONDUIT__HPP__
+#define __ASYNC_BOUNDARY_RECONDUIT__HPP__
+
+#include "ReConduitFwd.hpp"
+#include "ReConduitRing.hpp"
+#include "ReConduitPool.hpp"
+#include "BatchMessage.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Message on its way across an async boundary. The envelope owns a copy of
+// the payload, taken from the pools, as the sender is gone by the time it is
+// delivered. The origin of control messages does not cross: it is a conduit
+// of the threads feeding the boundary, which those behind it must not touch
+// (a factory calling insertInSideB() on it would change the table of a mux
+// while its own thread reads it). Control messages come out of a boundary
+// with a null origin, and factories behind it set routes up in the conduits
+// they are linked to.
+template<typename T>
+struct AsyncEnvelope
+{
+    enum class Kind : std::uint8_t { setup, release, alerting, information_chunk };
+
+    T*   payload_;
+    Kind kind_;
+};
+
+// Hands messages over from the threads feeding it to a worker thread of its
+// own, which delivers them to the downstream conduit. That conduit, and
+// whatever lies behind it, is then driven by the worker only.
+//
+// Senders wait while the ring is full. Consecutive information chunks are
+// delivered as one Batch, so batch aware conduits behind the boundary get
+// them at once. Senders must be done before the channel is destroyed; what
+// is still queued then is delivered first.
+template<typename T, template<typename, std::size_t> class Ring = MpscRing, std::size_t Capacity = 1024>
+class AsyncChannel
+{
+    using Envelope = AsyncEnvelope<T>;
+    using Kind     = typename Envelope::Kind;
+
+public:
+
+    static constexpr std::size_t max_batch = 32;
+
+    explicit AsyncChannel(Conduit& downstream)
+        : downstream_{ &downstream }
+        , pushed_{}
+        , delivered_{}
+        , sleeping_{}
+        , stop_{}
+        , worker_{ [ this ]{ run(); } }
+    {}
+
+    ~AsyncChannel()
+    {
+        stop_.store( true, std::memory_order_release );
+        wake();
+        worker_.join();
+    }
+
+    AsyncChannel(const AsyncChannel&)            = delete;
+    AsyncChannel& operator=(const AsyncChannel&) = delete;
+
+    void push(auto&& msg)
+    {
+        using M = std::decay_t<decltype(msg)>;
+        auto payload = new ( getFromPool<sizeof(T), alignof(T)>() ) T( msg.get() );
+        auto envelope = Envelope{ payload, Kind::information_chunk };
+        if constexpr ( std::is_same_v<M, Setup<T>> )    envelope.kind_ = Kind::setup;
+        if constexpr ( std::is_same_v<M, Release<T>> )  envelope.kind_ = Kind::release;
+        if constexpr ( std::is_same_v<M, Alerting<T>> ) envelope.kind_ = Kind::alerting;
+
+        pushed_.fetch_add( 1, std::memory_order_relaxed );
+        while( ! ring_.tryPush( envelope ) ) std::this_thread::yield();
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( sleeping_.load( std::memory_order_relaxed ) ) wake();
+    }
+
+    // Waits until everything pushed so far has been delivered.
+    void flush() const
+    {
+        auto pushed = pushed_.load( std::memory_order_relaxed );
+        while( delivered_.load( std::memory_order_acquire ) < pushed ) std::this_thread::yield();
+    }
+
+    std::size_t delivered() const noexcept { return delivered_.load( std::memory_order_acquire ); }
+
+private:
+
+    void run()
+    {
+        Envelope envelopes[ max_batch ];
+        for(;;) {
+            if( auto n = ring_.popBatch( envelopes, max_batch ) ) {
+                deliver( envelopes, n );
+            } else if( stop_.load( std::memory_order_acquire ) ) {
+                if( ring_.empty() ) return;
+            } else {
+                sleep();
+            }
+        }
+    }
+
+    void deliver(Envelope* envelopes, std::size_t n)
+    {
+        auto forward = [ this ](auto&& message) { send( downstream_, message ); };
+        T* chunks[ max_batch ];
+        auto pending = std::size_t{};
+        auto deliver_chunks = [ & ]
+        {
+            if( pending ) forward( Batch<T>{ chunks, pending } );
+            pending = 0;
+        };
+        for( auto e = envelopes; e != envelopes + n; ++e ) {
+            auto& payload = *e->payload_;
+            switch( e->kind_ ) {
+                case Kind::information_chunk: chunks[ pending++ ] = e->payload_; continue;
+                case Kind::setup:    deliver_chunks(); forward( Setup<T>{ payload, nullptr } ); break;
+                case Kind::release:  deliver_chunks(); forward( Release<T>{ payload, nullptr } ); break;
+                case Kind::alerting: deliver_chunks(); forward( Alerting<T>{ payload, nullptr } ); break;
+            }
+        }
+        deliver_chunks();
+        for( auto e = envelopes; e != envelopes + n; ++e ) {
+            e->payload_->~T();
+            putToPool<sizeof(T), alignof(T)>( e->payload_ );
+        }
+        delivered_.fetch_add( n, std::memory_order_release );
+    }
+
+    // Senders look at sleeping_ after pushing, and the worker at the ring
+    // after raising sleeping_, so one of them always sees the other. The
+    // notification takes the mutex, so it cannot get in before the wait.
+    void sleep()
+    {
+        std::unique_lock<std::mutex> lock{ mutex_ };
+        sleeping_.store( true, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( ring_.empty() && ! stop_.load( std::memory_order_acquire ) ) {
+            wakeup_.wait( lock );
+        }
+        sleeping_.store( false, std::memory_order_relaxed );
+    }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        wakeup_.notify_one();
+    }
+
+    Conduit* downstream_;
+    Ring<Envelope, Capacity> ring_;
+    alignas(cache_line_size) std::atomic<std::size_t> pushed_;
+    alignas(cache_line_size) std::atomic<std::size_t> delivered_;
+    std::atomic<bool> sleeping_;
+    std::atomic<bool> stop_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::thread worker_;
+};
+
+template<typename T, std::size_t Capacity = 1024>
+using SpscChannel = AsyncChannel<T, SpscRing, Capacity>;
+
+template<typename T, std::size_t Capacity = 1024>
+using MpscChannel = AsyncChannel<T, MpscRing, Capacity>;
+
+// User protocol ending the synchronous part of a path: whatever it accepts is
+// queued in its channel and the caller returns at once, e.g.
+//
+//     MpscChannel<Message> lua_channel{ l4_lua_mux };
+//     Conduit boundary{ Protocol{ AsyncBoundary<MpscChannel<Message>>{ lua_channel } } };
+//     tcp_parser.setSideB( boundary );
+template<typename Channel>
+class AsyncBoundary
+{
+public:
+
+    explicit AsyncBoundary(Channel& channel) noexcept : channel_{ &channel } {}
+
+    constexpr auto accept(auto&& msg, Conduit*)
+    {
+        channel_->push( msg );
+        return std::pair{ NextSide::done, make_variant_message( msg ) };
+    }
+
+    constexpr auto acceptBatch(auto&& batch, Conduit*)
+    {
+        for( auto m : batch ) channel_->push( InformationChunk<std::decay_t<decltype(*m)>>{ *m } );
+        return std::pair{ NextSide::done, batch };
+    }
+
+private:
+
+    Channel* channel_;
+};
+
+}
+
+#endif  // __ASYNC_BOUNDARY_RECONDUIT__HPP__
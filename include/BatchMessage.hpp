@@ -0,0 +1,139 @@
+#ifndef __BATCH_MESSAGE_RECONDUIT__HPP__
+#define __BATCH_MESSAGE_RECONDUIT__HPP__
+
+#include "InformationChunkMessage.hpp"
+#include "MessageArena.hpp"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace reconduits {
+
+class Conduit;
+
+// Burst of information chunks travelling through the graph as a unit.
+//
+// A batch does not own its messages: it refers to an array of pointers which
+// must outlive the accept call it is given to. Sub-batches made by the
+// library live in the thread's message arena.
+template<typename T>
+class Batch
+{
+public:
+
+    using value_type = T;
+
+    constexpr Batch(T* const* items, std::size_t size) noexcept
+        : items_{ items }
+        , size_{ size }
+    {}
+
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+
+    constexpr T& operator[](std::size_t i) const noexcept { return *items_[ i ]; }
+
+    constexpr T* const* begin() const noexcept { return items_; }
+    constexpr T* const* end() const noexcept { return items_ + size_; }
+
+private:
+
+    T* const*   items_;
+    std::size_t size_;
+};
+
+template<typename T> struct is_batch : std::false_type {};
+template<typename T> struct is_batch<Batch<T>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_batch_v = is_batch<std::decay_t<T>>::value;
+
+// User conduits opt in to whole batch processing by providing acceptBatch()
+// with the same arguments as their accept(). Those that do not are fed the
+// batch one InformationChunk at a time.
+template<typename U, typename B, typename = void>
+struct has_batch_accept : std::false_type {};
+
+template<typename U, typename B>
+struct has_batch_accept<U, B, std::void_t<decltype( std::declval<U&>().acceptBatch( std::declval<B&>() ) )>> : std::true_type {};
+
+template<typename U, typename B, typename = void>
+struct has_batch_accept_from : std::false_type {};
+
+template<typename U, typename B>
+struct has_batch_accept_from<U, B, std::void_t<decltype( std::declval<U&>().acceptBatch( std::declval<B&>(), std::declval<Conduit*>() ) )>> : std::true_type {};
+
+// Splits a batch by destination conduit, keeping the order of the messages
+// within every destination. Storage comes from the message arena; flushed
+// sub-batches are handed on to the walk (see Conduit::handOn()) and keep
+// theirs until it is over, partitions getting new ones. A partition that
+// fills up, or a destination that does not fit, makes the pending
+// sub-batches go early.
+template<typename T>
+class BatchPartitions
+{
+    struct Partition
+    {
+        Conduit*    next_;
+        T**         items_;
+        std::size_t size_;
+    };
+
+    static constexpr std::size_t max_partitions_ = 64;
+    static constexpr std::size_t max_items_      = 256;
+
+public:
+
+    explicit BatchPartitions(std::size_t batch_size)
+        : partitions_{}
+        , capacity_{ std::min( batch_size, max_items_ ) }
+        , used_{}
+        , allocated_{}
+    {}
+
+    void add(Conduit* next, T* item)
+    {
+        auto p = partitions_;
+        auto last = partitions_ + used_;
+        while( p != last && p->next_ != next ) ++p;
+        if( p == last ) {
+            if( used_ == max_partitions_ ) flush();
+            p = newPartition( next );
+        } else if( p->size_ == capacity_ ) {
+            flush( *p );
+        }
+        if( ! p->items_ ) p->items_ = static_cast<T**>( getMessageArena().allocate( capacity_ * sizeof(T*), alignof(T*) ) );
+        p->items_[ p->size_++ ] = item;
+    }
+
+    // Hands every pending sub-batch on to its conduit. Defined along with Conduit.
+    void flush();
+
+private:
+
+    void flush(Partition& p);
+
+    Partition* newPartition(Conduit* next)
+    {
+        auto& arena = getMessageArena();
+        if( ! partitions_ ) {
+            partitions_ = static_cast<Partition*>( arena.allocate( max_partitions_ * sizeof(Partition), alignof(Partition) ) );
+        }
+        if( used_ == allocated_ ) partitions_[ allocated_++ ] = Partition{ nullptr, nullptr, 0 };
+        auto p = partitions_ + used_++;
+        p->next_ = next;
+        p->size_ = 0;
+        return p;
+    }
+
+    Partition*  partitions_;
+    std::size_t capacity_;
+    std::size_t used_;
+    std::size_t allocated_;
+};
+
+}
+
+#endif  // __BATCH_MESSAGE_RECONDUIT__HPP__
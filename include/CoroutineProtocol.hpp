@@ -0,0 +1,213 @@
+#ifndef __COROUTINE_PROTOCOL_RECONDUIT__HPP__
+#define __COROUTINE_PROTOCOL_RECONDUIT__HPP__
+
+#include "ReConduitFwd.hpp"
+#include "ReConduitMemoryResource.hpp"
+
+// Needs compiler support for coroutines (-std=c++20, or -fcoroutines with GCC).
+#ifdef __cpp_impl_coroutine
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace reconduits {
+
+// Awaited by parsers for the next information chunk of their flow, which
+// they get by reference until their next wait. Side tells where the chunk in
+// hand goes meanwhile: on to side B by default, or nowhere with
+// NextSide::done. A chunk held back past a wait (e.g. a segment only part of
+// a record) is copied into the parser, and emitted later on if need be.
+struct NextChunk
+{
+    NextSide side_;
+};
+
+constexpr NextChunk next_chunk(NextSide side = NextSide::b) noexcept { return NextChunk{ side }; }
+
+// Awaited by parsers to send a chunk they own on to side, before the chunk
+// in hand goes on. It is through by the end of the wait, and may be reused.
+template<typename T>
+struct EmitChunk
+{
+    T*       chunk_;
+    NextSide side_;
+};
+
+template<typename T>
+constexpr EmitChunk<T> emit(T& chunk, NextSide side = NextSide::b) noexcept { return EmitChunk<T>{ &chunk, side }; }
+
+// Coroutine type of parsers, written as one straight loop over the chunks
+// of a flow instead of a state machine:
+//
+//     ChunkTask<Message> operator()()
+//     {
+//         Message first = co_await next_chunk();
+//         auto& second = co_await next_chunk( NextSide::done );
+//         co_await emit( first );
+//         ...
+//     }
+//
+// Frames, and so the chunks copied into them, are allocated from the conduit
+// pools.
+template<typename T>
+class ChunkTask
+{
+public:
+
+    using value_type = T;
+
+    struct promise_type
+    {
+        T*       chunk_{};
+        bool     fresh_{};
+        NextSide side_{ NextSide::b };
+        T*       emitted_{};
+        NextSide emitted_side_{ NextSide::b };
+        std::exception_ptr exception_;
+
+        struct Awaiter
+        {
+            promise_type* promise_;
+            NextSide      side_;
+
+            // The chunk the parser was resumed for is handed at once.
+            bool await_ready() const noexcept { return promise_->fresh_; }
+            void await_suspend(std::coroutine_handle<promise_type>) const noexcept { promise_->side_ = side_; }
+            T& await_resume() const noexcept
+            {
+                promise_->fresh_ = false;
+                return *promise_->chunk_;
+            }
+        };
+
+        ChunkTask get_return_object() noexcept { return ChunkTask{ std::coroutine_handle<promise_type>::from_promise( *this ) }; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_always final_suspend() const noexcept { return {}; }
+        void return_void() noexcept { side_ = NextSide::b; }
+        void unhandled_exception() noexcept { exception_ = std::current_exception(); }
+
+        struct EmitAwaiter
+        {
+            promise_type* promise_;
+            EmitChunk<T>  emit_;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type>) const noexcept
+            {
+                promise_->emitted_      = emit_.chunk_;
+                promise_->emitted_side_ = emit_.side_;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        Awaiter await_transform(NextChunk next) noexcept { return Awaiter{ this, next.side_ }; }
+        EmitAwaiter await_transform(EmitChunk<T> emit) noexcept { return EmitAwaiter{ this, emit }; }
+
+        static void* operator new(std::size_t size) { return getPoolResource()->allocate( size, alignof(std::max_align_t) ); }
+        static void operator delete(void* frame, std::size_t size) { getPoolResource()->deallocate( frame, size, alignof(std::max_align_t) ); }
+    };
+
+    ChunkTask() noexcept = default;
+    ChunkTask(ChunkTask&& rhs) noexcept : handle_{ std::exchange( rhs.handle_, {} ) } {}
+
+    ChunkTask& operator=(ChunkTask&& rhs) noexcept
+    {
+        if( this != &rhs ) {
+            if( handle_ ) handle_.destroy();
+            handle_ = std::exchange( rhs.handle_, {} );
+        }
+        return *this;
+    }
+
+    ~ChunkTask()
+    {
+        if( handle_ ) handle_.destroy();
+    }
+
+    explicit operator bool() const noexcept { return static_cast<bool>( handle_ ); }
+    bool done() const noexcept { return ! handle_ || handle_.done(); }
+
+    // Runs the parser on chunk up to its next wait, telling where chunk goes.
+    // Chunks the parser emits meanwhile are handed to emit( chunk, side ).
+    // Chunks coming after the parser is over go on to side B.
+    NextSide resume(T& chunk, auto&& emit)
+    {
+        if( done() ) return NextSide::b;
+        auto& promise = handle_.promise();
+        promise.chunk_ = &chunk;
+        promise.fresh_ = true;
+        for( step(); promise.emitted_; step() ) emit( *std::exchange( promise.emitted_, nullptr ), promise.emitted_side_ );
+        return promise.side_;
+    }
+
+private:
+
+    explicit ChunkTask(std::coroutine_handle<promise_type> handle) noexcept : handle_{ handle } {}
+
+    void step()
+    {
+        handle_.resume();
+        auto& promise = handle_.promise();
+        if( promise.exception_ ) std::rethrow_exception( std::exchange( promise.exception_, {} ) );
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// User protocol running a parser coroutine over the information chunks of
+// the flow it belongs to, so it is meant to be created per flow by a factory.
+// Other messages go on to side B. The parser is started on the first chunk,
+// once the protocol sits in its conduit, and so may refer to itself.
+//
+// Chunks the parser emits go back through the conduit of the protocol, on
+// to the side they are emitted to, while the parser waits for them. Chunks
+// coming back to the protocol meanwhile go on to side B.
+template<typename Parser>
+class CoroutineProtocol
+{
+public:
+
+    using task_type  = std::decay_t<decltype( std::declval<Parser&>()() )>;
+    using value_type = typename task_type::value_type;
+
+    constexpr CoroutineProtocol() = default;
+    constexpr explicit CoroutineProtocol(Parser parser) : parser_{ std::move( parser ) } {}
+
+    Parser& parser() noexcept { return parser_; }
+    bool done() const noexcept { return task_ && task_.done(); }
+
+    auto accept(auto&& msg, Conduit* ctx_conduit)
+    {
+        if constexpr ( std::is_same_v<std::decay_t<decltype(msg)>, InformationChunk<value_type>> ) {
+            if( &msg.get() == passing_ ) return std::pair{ passing_side_, make_variant_message( msg ) };
+            if( passing_ ) return std::pair{ NextSide::b, make_variant_message( msg ) };
+            if( ! task_ ) task_ = parser_();
+            auto emit = [ & ](value_type& chunk, NextSide side)
+            {
+                passing_      = &chunk;
+                passing_side_ = side;
+                send( ctx_conduit, InformationChunk<value_type>{ chunk } );
+                passing_ = nullptr;
+            };
+            return std::pair{ task_.resume( msg.get(), emit ), make_variant_message( msg ) };
+        } else {
+            return std::pair{ NextSide::b, make_variant_message( msg ) };
+        }
+    }
+
+private:
+
+    Parser      parser_;
+    task_type   task_;
+    value_type* passing_{};
+    NextSide    passing_side_{ NextSide::b };
+};
+
+}
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // __COROUTINE_PROTOCOL_RECONDUIT__HPP__
@@ -0,0 +1,279 @@
+#ifndef __CREDIT_GATE_RECONDUIT__HPP__
+#define __CREDIT_GATE_RECONDUIT__HPP__
+
+#include "ReConduitFwd.hpp"
+#include "ReConduitPool.hpp"
+#include "ReConduitMagazine.hpp"
+#include "ReConduitMemoryResource.hpp"
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace reconduits {
+
+// What a CreditGate does with an information chunk finding no credit left.
+enum class BackpressurePolicy
+{
+    block,          // the sender waits for a credit
+    drop_newest,    // the chunk is dropped
+    drop_oldest,    // the chunk is held back, dropping the oldest held one when full
+    spill,          // the chunk is diverted to a spill conduit
+};
+
+struct CreditStats
+{
+    std::size_t credits;    // available now
+    std::size_t granted;
+    std::size_t forwarded;
+    std::size_t dropped;
+    std::size_t spilled;
+    std::size_t blocked;
+    std::size_t alerts;
+};
+
+// Credits of the edge between a CreditGate and the conduits behind it, which
+// give them back as they get through the chunks, from any thread, either
+// through a CreditReturn or by calling grant() themselves.
+class CreditEdge
+{
+public:
+
+    explicit CreditEdge(std::size_t credits) noexcept
+        : credits_{ credits }
+        , stalled_{}
+        , granted_{}
+        , forwarded_{}
+        , dropped_{}
+        , spilled_{}
+        , blocked_{}
+        , alerts_{}
+    {}
+
+    CreditEdge(const CreditEdge&)            = delete;
+    CreditEdge& operator=(const CreditEdge&) = delete;
+
+    bool tryAcquire() noexcept
+    {
+        auto credits = credits_.load( std::memory_order_relaxed );
+        while( credits ) {
+            if( credits_.compare_exchange_weak( credits, credits - 1, std::memory_order_acquire, std::memory_order_relaxed ) ) return true;
+        }
+        return false;
+    }
+
+    void grant(std::size_t credits = 1) noexcept
+    {
+        granted_.fetch_add( credits, std::memory_order_relaxed );
+        credits_.fetch_add( credits, std::memory_order_release );
+        stalled_.store( false, std::memory_order_relaxed );
+    }
+
+    std::size_t available() const noexcept { return credits_.load( std::memory_order_acquire ); }
+
+    CreditStats stats() const noexcept
+    {
+        return CreditStats{ available(),
+                            granted_.load( std::memory_order_relaxed ),
+                            forwarded_.load( std::memory_order_relaxed ),
+                            dropped_.load( std::memory_order_relaxed ),
+                            spilled_.load( std::memory_order_relaxed ),
+                            blocked_.load( std::memory_order_relaxed ),
+                            alerts_.load( std::memory_order_relaxed ) };
+    }
+
+private:
+
+    template<typename T>
+    friend class CreditGate;
+
+    static void count(std::atomic<std::size_t>& counter) noexcept { counter.fetch_add( 1, std::memory_order_relaxed ); }
+
+    alignas(cache_line_size) std::atomic<std::size_t> credits_;
+    std::atomic<bool> stalled_;
+    alignas(cache_line_size) std::atomic<std::size_t> granted_;
+    alignas(cache_line_size) std::atomic<std::size_t> forwarded_;
+    std::atomic<std::size_t> dropped_;
+    std::atomic<std::size_t> spilled_;
+    std::atomic<std::size_t> blocked_;
+    std::atomic<std::size_t> alerts_;
+};
+
+// User protocol letting information chunks on to side B only while its edge
+// has credits, e.g. in front of an AsyncBoundary or a slow sink:
+//
+//     CreditEdge edge{ 1024 };
+//     Conduit gate{ Protocol{ CreditGate<Message>{ edge, BackpressurePolicy::drop_oldest } } };
+//     Conduit credits{ Protocol{ CreditReturn{ edge } } };
+//
+// When it runs out, the first chunk it refuses goes back to side A as an
+// Alerting, telling upstream to stop sending until credits come back. Other
+// message kinds are never held.
+//
+// Chunks held back by drop_oldest are kept in a ring taken from the pools.
+// They only ever go on from the thread feeding the gate, ahead of the next
+// message it gets, as soon as there are credits for them: credits coming
+// back from other threads are only counted. Each of them takes a credit of
+// its own, as does every chunk let on. Like any conduit, a gate is fed by
+// one thread at a time.
+template<typename T>
+class CreditGate
+{
+public:
+
+    explicit CreditGate(CreditEdge& edge, BackpressurePolicy policy = BackpressurePolicy::block, std::size_t backlog = 64)
+        : edge_{ &edge }
+        , spill_{}
+        , policy_{ policy }
+        , backlog_size_{ backlog }
+        , backlog_{}
+        , first_{}
+        , held_{}
+        , passing_{}
+    {}
+
+    CreditGate(CreditEdge& edge, Conduit& spill)
+        : CreditGate{ edge, BackpressurePolicy::spill }
+    {
+        spill_ = &spill;
+    }
+
+    // Held chunks move along with the gate.
+    CreditGate(CreditGate&& rhs) noexcept
+        : edge_{ rhs.edge_ }
+        , spill_{ rhs.spill_ }
+        , policy_{ rhs.policy_ }
+        , backlog_size_{ rhs.backlog_size_ }
+        , backlog_{ std::exchange( rhs.backlog_, nullptr ) }
+        , first_{ std::exchange( rhs.first_, 0 ) }
+        , held_{ std::exchange( rhs.held_, 0 ) }
+        , passing_{}
+    {}
+
+    ~CreditGate()
+    {
+        for( ; held_; --held_, ++first_ ) release( first_ );
+        if( backlog_ ) getPoolResource()->deallocate( backlog_, backlog_size_ * sizeof(T), alignof(T) );
+    }
+
+    std::size_t held() const noexcept { return held_; }
+
+    auto accept(auto&& msg, Conduit* ctx_conduit)
+    {
+        if constexpr ( std::is_same_v<std::decay_t<decltype(msg)>, InformationChunk<T>> ) {
+            // A held chunk on its way on, its credit already taken.
+            if( &msg.get() == passing_ ) return forward( msg );
+            if( ! passing_ ) drain( ctx_conduit );
+            if( ! held() && edge_->tryAcquire() ) return forward( msg );
+            return refuse( msg, ctx_conduit );
+        } else {
+            if( ! passing_ ) drain( ctx_conduit );
+            return std::pair{ NextSide::b, make_variant_message( msg ) };
+        }
+    }
+
+private:
+
+    auto forward(auto&& msg)
+    {
+        CreditEdge::count( edge_->forwarded_ );
+        return std::pair{ NextSide::b, make_variant_message( msg ) };
+    }
+
+    auto refuse(auto&& msg, Conduit* ctx_conduit)
+    {
+        switch( policy_ ) {
+            case BackpressurePolicy::block:
+                CreditEdge::count( edge_->blocked_ );
+                while( ! edge_->tryAcquire() ) std::this_thread::yield();
+                return forward( msg );
+            case BackpressurePolicy::drop_newest:
+                CreditEdge::count( edge_->dropped_ );
+                break;
+            case BackpressurePolicy::drop_oldest:
+                if( ! backlog_size_ ) {
+                    CreditEdge::count( edge_->dropped_ );
+                    break;
+                }
+                if( ! backlog_ ) backlog_ = static_cast<T*>( getPoolResource()->allocate( backlog_size_ * sizeof(T), alignof(T) ) );
+                if( held_ == backlog_size_ ) {
+                    release( first_ );
+                    first_ = ( first_ + 1 ) % backlog_size_;
+                    --held_;
+                    CreditEdge::count( edge_->dropped_ );
+                }
+                new ( &backlog_[ ( first_ + held_ ) % backlog_size_ ] ) T( msg.get() );
+                ++held_;
+                break;
+            case BackpressurePolicy::spill:
+                CreditEdge::count( edge_->spilled_ );
+                if( spill_ ) send( spill_, msg );
+                break;
+        }
+        if( ! edge_->stalled_.exchange( true, std::memory_order_relaxed ) ) {
+            CreditEdge::count( edge_->alerts_ );
+            return std::pair{ NextSide::a, make_variant_alerting_message( msg, ctx_conduit ) };
+        }
+        return std::pair{ NextSide::done, make_variant_message( msg ) };
+    }
+
+    // Held chunks are older than the message coming in, so they go first,
+    // back through the conduit of the gate as long as there are credits.
+    // Each leaves the ring before it is sent, so that chunks coming back to
+    // the gate meanwhile are held behind it.
+    void drain(Conduit* ctx_conduit)
+    {
+        while( held_ && edge_->tryAcquire() ) {
+            T chunk{ std::move( backlog_[ first_ ] ) };
+            release( first_ );
+            first_ = ( first_ + 1 ) % backlog_size_;
+            --held_;
+            passing_ = &chunk;
+            send( ctx_conduit, InformationChunk<T>{ chunk } );
+            passing_ = nullptr;
+        }
+    }
+
+    void release(std::size_t i) noexcept { backlog_[ i % backlog_size_ ].~T(); }
+
+    CreditEdge* edge_;
+    Conduit* spill_;
+    BackpressurePolicy policy_;
+    std::size_t backlog_size_;
+    T* backlog_;
+    std::size_t first_;
+    std::size_t held_;
+    const T* passing_;
+};
+
+// User protocol giving a credit back to its edge for every information chunk
+// getting through, everything going on to side B.
+class CreditReturn
+{
+public:
+
+    explicit CreditReturn(CreditEdge& edge) noexcept : edge_{ &edge } {}
+
+    auto accept(auto&& msg, Conduit*)
+    {
+        using M = std::decay_t<decltype(msg)>;
+        if constexpr ( std::is_same_v<M, InformationChunk<embedded_t<M>>> ) edge_->grant();
+        return std::pair{ NextSide::b, make_variant_message( msg ) };
+    }
+
+    auto acceptBatch(auto&& batch, Conduit*)
+    {
+        edge_->grant( batch.size() );
+        return std::pair{ NextSide::b, batch };
+    }
+
+private:
+
+    CreditEdge* edge_;
+};
+
+}
+
+#endif  // __CREDIT_GATE_RECONDUIT__HPP__
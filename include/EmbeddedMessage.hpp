@@ -1,7 +1,6 @@
 #ifndef __EMBEDDED_MESSAGE_RECONDUIT__HPP__
 #define __EMBEDDED_MESSAGE_RECONDUIT__HPP__
 
-#include "ReConduitPool.hpp"
 #include <type_traits>
 
 namespace reconduits {
@@ -16,14 +15,14 @@ public:
 
     using value_type = T;
 
-    explicit EmbeddedMessage(T& em) : embedded_message_{ em } {}
+    explicit EmbeddedMessage(T& em) : embedded_message_{ &em } {}
 
-    const T& get() const { return embedded_message_; }
-    T& get() { return embedded_message_; }
+    const T& get() const { return *embedded_message_; }
+    T& get() { return *embedded_message_; }
 
 private:
 
-    T& embedded_message_;
+    T* embedded_message_;
 };
 
 }
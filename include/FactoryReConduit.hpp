@@ -3,6 +3,8 @@
 
 #include "ReConduitVisitors.hpp"
 #include "ReConduitPool.hpp"
+#include "BatchMessage.hpp"
+#include "ReConduitFwd.hpp"
 
 #include <type_traits>
 
@@ -16,7 +18,17 @@ public:
     explicit Factory(T&& f)
         : conduit_to_side_a_{}
         , conduit_to_side_b_{}
-        , factory_{ new ( getFromPool<sizeof(T)>() ) T{ std::forward<T>( f ) } }
+        , factory_{ new ( getFromPool<sizeof(T), alignof(T)>() ) T{ std::forward<T>( f ) } }
+    {
+        SPDLOG_DEBUG(getLogger(), "New Factory Conduit [{0:p}] created", static_cast<void*>(this));
+    }
+
+    // Adopts a user object already placed by its Conduit.
+    template<typename T>
+    explicit Factory(PlacedUser<T> placed)
+        : conduit_to_side_a_{}
+        , conduit_to_side_b_{}
+        , factory_{ placed.user_ }
     {
         SPDLOG_DEBUG(getLogger(), "New Factory Conduit [{0:p}] created", static_cast<void*>(this));
     }
@@ -43,7 +55,7 @@ public:
             if( factory_ptr ) {
                 using T = std::decay_t<decltype( *factory_ptr )>;
                 factory_ptr->~T();
-                putToPool<sizeof(T)>( factory_ptr );
+                putToPool<sizeof(T), alignof(T)>( factory_ptr );
             }
         };
         dispatch(factory_, delete_factory);
@@ -57,21 +69,30 @@ private:
 
     friend Conduit;
 
+    constexpr auto& user() noexcept { return factory_; }
+
     constexpr void setSideA(Conduit& a) noexcept { conduit_to_side_a_ = &a; }
     constexpr void setSideB(Conduit& b) noexcept { conduit_to_side_b_ = &b; }
 
-    constexpr auto accept(auto&& v_msg, Conduit* ctx_conduit)
+    constexpr auto accept(auto v_msg, Conduit* ctx_conduit)
     {
         SPDLOG_DEBUG(getLogger(), "Factory Conduit [{:p}] with [a,b] -> [{:p}, {:p}] accepts a new message.",
                 static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b_));
-        auto accept = [ & ](auto&& factory_ptr, auto&& msg_ptr)
+        auto accept = [ & ](auto&& factory_ptr, auto&& msg)
         {
-            return factory_ptr->accept(*msg_ptr, this->conduit_to_side_a_, this->conduit_to_side_b_);
+            return factory_ptr->accept(msg, this->conduit_to_side_a_, this->conduit_to_side_b_);
         };
         auto next_conduit = doubleDispatch_r(factory_, v_msg, accept);
         return std::pair{ next_conduit, v_msg };
     }
 
+    // Factories deal with Setup and Release messages, one at a time.
+    constexpr auto acceptBatch(auto batch, Conduit* ctx_conduit)
+    {
+        ctx_conduit->acceptEach( batch );
+        return std::pair{ static_cast<Conduit*>( nullptr ), batch };
+    }
+
     Conduit* conduit_to_side_a_;
     Conduit* conduit_to_side_b_;
     factory_type factory_;
@@ -0,0 +1,517 @@
+#ifndef __FLAT_FLOW_TABLE_RECONDUIT__HPP__
+#define __FLAT_FLOW_TABLE_RECONDUIT__HPP__
+
+#include "ReConduitMemoryResource.hpp"
+#include "RouteCache.hpp"
+
+#include <sys/mman.h>
+
+#include <memory_resource>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace reconduits {
+
+namespace flat_table_detail {
+
+constexpr std::size_t group_size = 16;
+constexpr std::int8_t empty = -128;
+constexpr std::int8_t moved = -2;   // only in the old slots of an incremental rehash
+
+// Control bytes of group_size consecutive slots: empty, moved, or the 7 high
+// bits of the hash of the key in the slot. One SSE2 compare tells the
+// candidates.
+class Group
+{
+public:
+
+#if defined(__SSE2__)
+    explicit Group(const std::int8_t* ctrl) noexcept
+        : ctrl_{ _mm_loadu_si128( reinterpret_cast<const __m128i*>( ctrl ) ) }
+    {}
+
+    std::uint32_t match(std::int8_t h2) const noexcept
+    {
+        return static_cast<std::uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( ctrl_, _mm_set1_epi8( h2 ) ) ) );
+    }
+
+    std::uint32_t matchEmpty() const noexcept { return match( empty ); }
+
+private:
+
+    __m128i ctrl_;
+#else
+    explicit Group(const std::int8_t* ctrl) noexcept { std::memcpy( ctrl_, ctrl, group_size ); }
+
+    std::uint32_t match(std::int8_t h2) const noexcept
+    {
+        std::uint32_t mask{};
+        for( auto i = std::size_t{}; i < group_size; ++i ) mask |= std::uint32_t( ctrl_[ i ] == h2 ) << i;
+        return mask;
+    }
+
+    std::uint32_t matchEmpty() const noexcept { return match( empty ); }
+
+private:
+
+    std::int8_t ctrl_[ group_size ];
+#endif
+};
+
+}
+
+// How a FlatFlowTable grows: all entries at once, or Budget old slots at a
+// time on every insertion, lookup or erasure. From a Budget of 2, the old
+// slots are all moved before the table grows again; otherwise growing
+// finishes the move in one go.
+struct OneShotRehash
+{
+    static constexpr std::size_t budget = 0;
+};
+
+template<std::size_t Budget = 4>
+struct IncrementalRehash
+{
+    static_assert(Budget > 0, "Incremental rehashing needs to move entries");
+    static constexpr std::size_t budget = Budget;
+};
+
+// Open addressing table of flows, their values stored inline. Slots are
+// probed linearly, group_size control bytes at a time (Swiss table style),
+// and erasing shifts the following entries back instead of leaving
+// tombstones, so lookups never walk over deleted slots. The table is kept at
+// most 7/8 full. Values move on growth and erase, so pointers to them only
+// last until the next insertion or erasure (or lookup, while rehashing
+// incrementally).
+//
+// With IncrementalRehash, growing keeps the old slots next to the new ones
+// and every insertion, lookup or erasure moves the entries of Budget old
+// slots across, so no single call pays for the whole table. The new slots
+// are allocated ahead, once the table is 3/4 full, and made ready a few at
+// a time by the insertions up to growth: control bytes set to empty and
+// pages touched, so that neither stalls one insertion nor the ones right
+// after growth. The pages of old slots left behind go back to the system
+// as the move goes on, rather than all at once when it is over. Memory
+// peaks at old plus new slots either way, but for longer.
+//
+// Old slots left behind are marked as moved rather than emptied, so that
+// probing the old slots still walks over them to the entries that are still
+// there; erasing from the old slots marks them the same way.
+template<typename Key, typename Value, typename Hash = FlowHash<Key>, typename KeyEqual = std::equal_to<Key>, typename Rehash = OneShotRehash>
+class FlatFlowTable
+{
+    static constexpr std::size_t group_size = flat_table_detail::group_size;
+    static constexpr std::size_t min_capacity = group_size;
+    static constexpr std::size_t npos = ~std::size_t{};
+    static constexpr std::size_t page_size = 4096;
+
+    // New slots made ready by every insertion past 3/4 full: twice the
+    // capacity is ready well before the 1/8 left to growth is inserted.
+    static constexpr std::size_t prepare_step = 2 * group_size;
+
+    // Bytes of moved old slots given back to the system at once.
+    static constexpr std::size_t release_step = 64 * page_size;
+
+    struct Slot
+    {
+        Key   key_;
+        Value value_;
+    };
+
+    struct Storage
+    {
+        std::int8_t* ctrl_{};
+        Slot*        slots_{};
+        std::size_t  capacity_{};
+        std::size_t  size_{};
+
+        std::size_t mask() const noexcept { return capacity_ - 1; }
+        bool full(std::size_t i) const noexcept { return ctrl_[ i ] >= 0; }
+
+        std::size_t indexOf(const Key& key, std::uint64_t hash) const noexcept
+        {
+            if( ! size_ ) return npos;
+            auto h2 = h2Of( hash );
+            for( auto pos = hash & mask(); ; pos = ( pos + group_size ) & mask() ) {
+                flat_table_detail::Group group{ ctrl_ + pos };
+                for( auto m = group.match( h2 ); m; m &= m - 1 ) {
+                    auto i = ( pos + __builtin_ctz( m ) ) & mask();
+                    if( KeyEqual{}( slots_[ i ].key_, key ) ) return i;
+                }
+                if( group.matchEmpty() ) return npos;
+            }
+        }
+
+        void prefetch(std::uint64_t hash) const noexcept
+        {
+            if( ! size_ ) return;
+            __builtin_prefetch( ctrl_ + ( hash & mask() ) );
+            __builtin_prefetch( slots_ + ( hash & mask() ) );
+        }
+
+        std::size_t emptyIndexFor(std::uint64_t hash) const noexcept
+        {
+            for( auto pos = hash & mask(); ; pos = ( pos + group_size ) & mask() ) {
+                if( auto m = flat_table_detail::Group{ ctrl_ + pos }.matchEmpty() ) return ( pos + __builtin_ctz( m ) ) & mask();
+            }
+        }
+
+        // The first group_size - 1 control bytes are cloned past the end, so
+        // that a group can be loaded from any slot.
+        void setCtrl(std::size_t i, std::int8_t ctrl) noexcept
+        {
+            ctrl_[ i ] = ctrl;
+            if( i < group_size - 1 ) ctrl_[ capacity_ + i ] = ctrl;
+        }
+
+        template<typename... Args>
+        Slot& emplace(std::uint64_t hash, Args&&... args)
+        {
+            auto i = emptyIndexFor( hash );
+            auto slot = new ( &slots_[ i ] ) Slot{ std::forward<Args>( args )... };
+            setCtrl( i, h2Of( hash ) );
+            ++size_;
+            return *slot;
+        }
+
+        // Backward shift: entries after the erased one move back into the
+        // hole as long as that keeps them at or after their home slot.
+        void eraseAt(std::size_t hole)
+        {
+            slots_[ hole ].~Slot();
+            for( auto i = ( hole + 1 ) & mask(); full( i ); i = ( i + 1 ) & mask() ) {
+                auto home = hashOf( slots_[ i ].key_ ) & mask();
+                if( ( ( i - home ) & mask() ) >= ( ( i - hole ) & mask() ) ) {
+                    new ( &slots_[ hole ] ) Slot{ std::move( slots_[ i ] ) };
+                    slots_[ i ].~Slot();
+                    setCtrl( hole, ctrl_[ i ] );
+                    hole = i;
+                }
+            }
+            setCtrl( hole, flat_table_detail::empty );
+            --size_;
+        }
+
+        void clear() noexcept
+        {
+            for( auto i = std::size_t{}; size_ && i < capacity_; ++i ) {
+                if( full( i ) ) {
+                    slots_[ i ].~Slot();
+                    setCtrl( i, flat_table_detail::empty );
+                    --size_;
+                }
+            }
+        }
+    };
+
+public:
+
+    using key_type    = Key;
+    using mapped_type = Value;
+
+    static constexpr bool incremental = Rehash::budget > 0;
+
+    // Keys hashed and prefetched ahead of their lookups by find_many().
+    static constexpr std::size_t lookup_group = 16;
+
+    explicit FlatFlowTable(std::pmr::memory_resource* resource = getPoolResource())
+        : resource_{ resource }
+        , current_{}
+        , old_{}
+        , next_{}
+        , prepared_{}
+        , cursor_{}
+        , released_{}
+        , hand_{}
+        , version_{}
+    {}
+
+    FlatFlowTable(FlatFlowTable&& rhs) noexcept
+        : resource_{ rhs.resource_ }
+        , current_{ std::exchange( rhs.current_, Storage{} ) }
+        , old_{ std::exchange( rhs.old_, Storage{} ) }
+        , next_{ std::exchange( rhs.next_, Storage{} ) }
+        , prepared_{ rhs.prepared_ }
+        , cursor_{ rhs.cursor_ }
+        , released_{ rhs.released_ }
+        , hand_{ rhs.hand_ }
+        , version_{ rhs.version_ }
+    {}
+
+    FlatFlowTable& operator=(FlatFlowTable&& rhs) noexcept
+    {
+        if( this != &rhs ) {
+            clear();
+            deallocate( current_ );
+            deallocate( next_ );
+            resource_ = rhs.resource_;
+            current_  = std::exchange( rhs.current_, Storage{} );
+            old_      = std::exchange( rhs.old_, Storage{} );
+            next_     = std::exchange( rhs.next_, Storage{} );
+            prepared_ = rhs.prepared_;
+            cursor_   = rhs.cursor_;
+            released_ = rhs.released_;
+            hand_     = rhs.hand_;
+            ++version_;
+        }
+        return *this;
+    }
+
+    FlatFlowTable(const FlatFlowTable&)            = delete;
+    FlatFlowTable& operator=(const FlatFlowTable&) = delete;
+
+    ~FlatFlowTable()
+    {
+        clear();
+        deallocate( current_ );
+        deallocate( next_ );
+    }
+
+    std::size_t size() const noexcept { return current_.size_ + old_.size_; }
+    bool empty() const noexcept { return size() == 0; }
+    std::size_t capacity() const noexcept { return current_.capacity_; }
+    bool rehashing() const noexcept { return old_.capacity_ != 0; }
+
+    // Changes whenever entries may have moved or gone, so that pointers to
+    // values got at some version are only valid while it lasts. Insertions
+    // that do not grow the table keep it: a key missing at some version may
+    // have been added since.
+    std::uint64_t version() const noexcept { return version_; }
+
+    Value* find(const Key& key) noexcept
+    {
+        migrate( Rehash::budget );
+        return const_cast<Value*>( std::as_const( *this ).find( key ) );
+    }
+
+    const Value* find(const Key& key) const noexcept { return findHashed( key, hashOf( key ) ); }
+
+    // Lookups of a burst of keys. Every key of a group is hashed and its home
+    // slot prefetched before any of them is looked up, so that their cache
+    // misses overlap instead of coming one after the other.
+    void find_many(const Key* keys, std::size_t n, Value** found) noexcept
+    {
+        migrate( Rehash::budget );
+        std::uint64_t hashes[ lookup_group ];
+        for( auto first = std::size_t{}; first < n; first += lookup_group ) {
+            auto group = std::min( lookup_group, n - first );
+            for( auto i = std::size_t{}; i < group; ++i ) {
+                hashes[ i ] = hashOf( keys[ first + i ] );
+                current_.prefetch( hashes[ i ] );
+                if constexpr ( incremental ) old_.prefetch( hashes[ i ] );
+            }
+            for( auto i = std::size_t{}; i < group; ++i ) {
+                found[ first + i ] = const_cast<Value*>( findHashed( keys[ first + i ], hashes[ i ] ) );
+            }
+        }
+    }
+
+    // Value of key, built from args unless key is already there.
+    template<typename... Args>
+    std::pair<Value*, bool> try_emplace(const Key& key, Args&&... args)
+    {
+        if( auto value = find( key ) ) return { value, false };
+        if( ( size() + 1 ) * 8 > current_.capacity_ * 7 ) grow( std::max( min_capacity, current_.capacity_ * 2 ) );
+        else if constexpr ( incremental ) {
+            if( ( size() + 1 ) * 4 > current_.capacity_ * 3 ) prepare( current_.capacity_ * 2 );
+        }
+        auto& slot = current_.emplace( hashOf( key ), key, Value{ std::forward<Args>( args )... } );
+        return { &slot.value_, true };
+    }
+
+    bool erase(const Key& key)
+    {
+        migrate( Rehash::budget );
+        auto hash = hashOf( key );
+        if( auto i = current_.indexOf( key, hash ); i != npos ) {
+            current_.eraseAt( i );
+            ++version_;
+            return true;
+        }
+        if( auto i = old_.indexOf( key, hash ); i != npos ) {
+            old_.slots_[ i ].~Slot();
+            old_.setCtrl( i, flat_table_detail::moved );
+            --old_.size_;
+            ++version_;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() noexcept
+    {
+        ++version_;
+        current_.clear();
+        old_.clear();
+        deallocate( old_ );
+    }
+
+    void reserve(std::size_t n)
+    {
+        migrate( npos );
+        auto capacity = std::max( min_capacity, current_.capacity_ );
+        while( n * 8 > capacity * 7 ) capacity *= 2;
+        if( capacity != current_.capacity_ ) grow( capacity );
+    }
+
+    template<typename F>
+    void forEach(F&& f)
+    {
+        for( auto storage : { &current_, &old_ } ) {
+            for( auto i = std::size_t{}; i < storage->capacity_; ++i ) {
+                if( storage->full( i ) ) f( std::as_const( storage->slots_[ i ].key_ ), storage->slots_[ i ].value_ );
+            }
+        }
+    }
+
+    // Clock hand over the slots: visits the entries in the next slots slots,
+    // going round the table over successive calls. Entries still in the old
+    // slots while rehashing are visited once they move across. f must not
+    // change the table.
+    template<typename F>
+    void sweep(std::size_t slots, F&& f)
+    {
+        if( ! current_.capacity_ ) return;
+        for( ; slots; --slots, ++hand_ ) {
+            auto i = hand_ & current_.mask();
+            if( current_.full( i ) ) f( std::as_const( current_.slots_[ i ].key_ ), current_.slots_[ i ].value_ );
+        }
+    }
+
+private:
+
+    static std::uint64_t hashOf(const Key& key) noexcept { return mixFlowHash( Hash{}( key ) ); }
+    static std::int8_t h2Of(std::uint64_t hash) noexcept { return static_cast<std::int8_t>( hash >> 57 ); }
+
+    const Value* findHashed(const Key& key, std::uint64_t hash) const noexcept
+    {
+        auto i = current_.indexOf( key, hash );
+        if( i != npos ) return &current_.slots_[ i ].value_;
+        if constexpr ( incremental ) {
+            if( ( i = old_.indexOf( key, hash ) ) != npos ) return &old_.slots_[ i ].value_;
+        }
+        return nullptr;
+    }
+
+    // The current slots become the old ones, and those prepared ahead the
+    // current ones. Growing again before they are all moved finishes the
+    // move first.
+    void grow(std::size_t capacity)
+    {
+        migrate( npos );
+        ++version_;
+        old_ = current_;
+        if( next_.capacity_ != capacity ) {
+            deallocate( next_ );
+            next_ = allocate( capacity );
+            prepared_ = 0;
+        }
+        initCtrl( next_, prepared_, capacity );
+        current_ = std::exchange( next_, Storage{} );
+        prepared_ = 0;
+        cursor_ = 0;
+        released_ = 0;
+        migrate( incremental ? Rehash::budget : npos );
+    }
+
+    // Moves the entries of the next budget old slots, from cursor_ on.
+    void migrate(std::size_t budget)
+    {
+        if( ! old_.capacity_ ) return;
+        auto left = old_.size_;
+        for( auto slots = std::size_t{}; old_.size_ && slots < budget; ++slots, ++cursor_ ) {
+            if( ! old_.full( cursor_ ) ) continue;
+            auto& slot = old_.slots_[ cursor_ ];
+            current_.emplace( hashOf( slot.key_ ), std::move( slot ) );
+            slot.~Slot();
+            old_.setCtrl( cursor_, flat_table_detail::moved );
+            --old_.size_;
+        }
+        if( old_.size_ != left ) ++version_;
+        if( ! old_.size_ ) deallocate( old_ );
+        else if constexpr ( incremental ) releaseMoved();
+    }
+
+    // Old slots before cursor_ are all moved or empty, so lookups only read
+    // their control bytes: whole pages of them go back to the system,
+    // release_step bytes at a time. Control bytes are kept, as zeroed ones
+    // would read as full.
+    void releaseMoved() noexcept
+    {
+        auto base  = reinterpret_cast<std::uintptr_t>( old_.slots_ );
+        auto first = ( base + released_ + page_size - 1 ) & ~( page_size - 1 );
+        auto last  = ( base + cursor_ * sizeof(Slot) ) & ~( page_size - 1 );
+        if( last < first + release_step ) return;
+        ::madvise( reinterpret_cast<void*>( first ), last - first, MADV_DONTNEED );
+        released_ = last - base;
+    }
+
+    // Readies the next prepare_step slots of the storage to grow into,
+    // allocated on the first call.
+    void prepare(std::size_t capacity)
+    {
+        if( next_.capacity_ != capacity ) {
+            deallocate( next_ );
+            next_ = allocate( capacity );
+            prepared_ = 0;
+        }
+        if( prepared_ == capacity ) return;
+        auto end = std::min( capacity, prepared_ + prepare_step );
+        auto slots = reinterpret_cast<volatile char*>( next_.slots_ );
+        for( auto page = ( prepared_ * sizeof(Slot) + page_size - 1 ) / page_size * page_size; page < end * sizeof(Slot); page += page_size ) {
+            slots[ page ] = 0;
+        }
+        initCtrl( next_, prepared_, end );
+        prepared_ = end;
+    }
+
+    // Control bytes of slots from first to last set to empty, with their
+    // clones past the end along with the last slot.
+    static void initCtrl(Storage& storage, std::size_t first, std::size_t last) noexcept
+    {
+        if( last == storage.capacity_ ) last += group_size;
+        if( first < last ) std::memset( storage.ctrl_ + first, static_cast<unsigned char>( flat_table_detail::empty ), last - first );
+    }
+
+    // Control bytes are left to initCtrl().
+    Storage allocate(std::size_t capacity)
+    {
+        Storage storage;
+        storage.ctrl_ = static_cast<std::int8_t*>( resource_->allocate( capacity + group_size, alignof(std::int8_t) ) );
+        storage.slots_ = static_cast<Slot*>( resource_->allocate( capacity * sizeof(Slot), alignof(Slot) ) );
+        storage.capacity_ = capacity;
+        return storage;
+    }
+
+    void deallocate(Storage& storage) noexcept
+    {
+        if( ! storage.capacity_ ) return;
+        resource_->deallocate( storage.ctrl_, storage.capacity_ + group_size, alignof(std::int8_t) );
+        resource_->deallocate( storage.slots_, storage.capacity_ * sizeof(Slot), alignof(Slot) );
+        storage = Storage{};
+    }
+
+    std::pmr::memory_resource* resource_;
+    Storage     current_;
+    Storage     old_;
+    Storage     next_;      // slots to grow into, while incremental
+    std::size_t prepared_;  // slots of next_ ready
+    std::size_t cursor_;    // next old slot to move across
+    std::size_t released_;  // bytes of old slots given back to the system
+    std::size_t hand_;      // next slot to sweep
+    std::uint64_t version_;
+};
+
+}
+
+#endif  // __FLAT_FLOW_TABLE_RECONDUIT__HPP__
@@ -0,0 +1,132 @@
+#ifndef __FLOW_AGING_RECONDUIT__HPP__
+#define __FLOW_AGING_RECONDUIT__HPP__
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Last time a flow was seen and how long it may stay idle, kept by every
+// entry of an aged mux table.
+template<typename Clock = std::chrono::steady_clock>
+struct FlowAge
+{
+    using time_point = typename Clock::time_point;
+    using duration   = typename Clock::duration;
+
+    time_point last_seen_;
+    duration   idle_timeout_;
+
+    // Messages a bit out of order never make a flow younger.
+    void touch(time_point now) noexcept { last_seen_ = std::max( last_seen_, now ); }
+    bool expired(time_point now) const noexcept { return now - last_seen_ > idle_timeout_; }
+};
+
+// Idle timeouts of the flows of a mux table, by protocol (IP protocol
+// number, application port...), and the sweep evicting the flows going
+// over them. Every sweep only looks at a few slots of the table, going round
+// it over successive messages like a clock hand:
+//
+//     FlowAging<> aging{ 2min };
+//     aging.idleTimeout( 53, 30s );
+//
+//     table.try_emplace( key, ..., aging.age( 53, now ) );   // new flow
+//     ctx->age_.touch( now );                                // every message
+//     aging.sweep( table, now, [ & ](const auto& key) { ... } );
+//
+// Table values keep their FlowAge in age_. Expired keys are handed to evict
+// once the table has been looked at, so evict may erase them.
+template<typename Clock = std::chrono::steady_clock>
+class FlowAging
+{
+public:
+
+    using clock_type = Clock;
+    using time_point = typename Clock::time_point;
+    using duration   = typename Clock::duration;
+
+    static constexpr std::size_t max_sweep = 16;
+
+    explicit FlowAging(duration idle_timeout, std::size_t sweep = 2)
+        : idle_timeout_{ idle_timeout }
+        , sweep_{ std::clamp( sweep, std::size_t{ 1 }, max_sweep ) }
+        , timeouts_{}
+    {}
+
+    FlowAging& idleTimeout(std::uint32_t protocol, duration timeout)
+    {
+        for( auto& [ p, t ] : timeouts_ ) {
+            if( p == protocol ) {
+                t = timeout;
+                return *this;
+            }
+        }
+        timeouts_.emplace_back( protocol, timeout );
+        return *this;
+    }
+
+    duration idleTimeout(std::uint32_t protocol) const noexcept
+    {
+        for( auto& [ p, t ] : timeouts_ ) {
+            if( p == protocol ) return t;
+        }
+        return idle_timeout_;
+    }
+
+    std::size_t sweepSize() const noexcept { return sweep_; }
+
+    FlowAge<Clock> age(std::uint32_t protocol, time_point now) const noexcept { return FlowAge<Clock>{ now, idleTimeout( protocol ) }; }
+
+    // Evicts the expired flows among the next sweepSize() slots of table.
+    template<typename Table, typename F>
+    std::size_t sweep(Table& table, time_point now, F&& evict)
+    {
+        std::array<typename Table::key_type, max_sweep> expired;
+        std::size_t n{};
+        table.sweep( sweep_, [ & ](const auto& key, const auto& value)
+        {
+            if( value.age_.expired( now ) ) expired[ n++ ] = key;
+        } );
+        for( auto i = std::size_t{}; i < n; ++i ) evict( std::as_const( expired[ i ] ) );
+        return n;
+    }
+
+private:
+
+    duration idle_timeout_;
+    std::size_t sweep_;
+    std::vector<std::pair<std::uint32_t, duration>> timeouts_;
+};
+
+// Muxes opt in to flow aging by expiring idle flows as information chunks go
+// by, handing a message standing for each of them to release:
+//
+//     void expire(auto&& msg, auto&& release) { ... release( timed_out_msg ); ... }
+//
+// The Mux conduit sends them to the factory on side B0 as Release messages,
+// which erases them from the mux as for any other closed flow.
+namespace flow_aging_detail {
+
+struct IgnoreExpired
+{
+    template<typename T>
+    void operator()(T&) const noexcept {}
+};
+
+}
+
+template<typename U, typename M, typename = void>
+struct has_flow_expiry : std::false_type {};
+
+template<typename U, typename M>
+struct has_flow_expiry<U, M, std::void_t<decltype( std::declval<U&>().expire( std::declval<M&>(), flow_aging_detail::IgnoreExpired{} ) )>> : std::true_type {};
+
+}
+
+#endif  // __FLOW_AGING_RECONDUIT__HPP__
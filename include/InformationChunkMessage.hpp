@@ -15,22 +15,6 @@ public:
 
     explicit InformationChunk(T& m)
         : EmbeddedMessage<T>{ m } {}
-
-    static void* operator new(std::size_t sz)
-    {
-        return getFromPool<sizeof(InformationChunk)>();
-    }
-
-    static void* operator new(std::size_t sz, InformationChunk* p)
-    {
-        return ::operator new(sz, p);
-    }
-
-    static void operator delete(void* p)
-    {
-        putToPool<sizeof(InformationChunk)>( p );
-    }
-
 };
 
 }
@@ -0,0 +1,137 @@
+#ifndef __MESSAGE_ARENA_RECONDUIT__HPP__
+#define __MESSAGE_ARENA_RECONDUIT__HPP__
+
+#include "ReConduitPool.hpp"
+
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Per thread bump arena for transient storage needed while a message travels
+// through the graph.
+//
+// Storage lives as long as the outermost Conduit::accept call (see
+// MessageArenaScope) and is rewound in O(1) when that call returns. Every
+// request gets its own storage, so nested and batched messages do not clobber
+// each other, and blocks are kept across calls so that the steady state does
+// not allocate at all.
+class MessageArena
+{
+    struct Block
+    {
+        Block* next_;
+    };
+
+    static constexpr std::size_t block_size_  = 4096;
+    static constexpr std::size_t header_size_ = roundUp(sizeof(Block), alignof(std::max_align_t));
+
+public:
+
+    MessageArena() noexcept
+        : first_{}
+        , current_{}
+        , cursor_{}
+        , end_{}
+        , depth_{}
+    {}
+
+    ~MessageArena()
+    {
+        while( first_ ) {
+            auto next = first_->next_;
+            putToPool<block_size_>( first_ );
+            first_ = next;
+        }
+    }
+
+    MessageArena(const MessageArena&)            = delete;
+    MessageArena& operator=(const MessageArena&) = delete;
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        auto p = alignUp( cursor_, alignment );
+        if( p + size > end_ ) {
+            if( size + alignment > block_size_ - header_size_ ) throw std::bad_alloc();
+            nextBlock();
+            p = alignUp( cursor_, alignment );
+        }
+        cursor_ = p + size;
+        return reinterpret_cast<void*>( p );
+    }
+
+    template<typename T, typename... A>
+    T* make(A&&... args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed");
+        return ::new ( allocate( sizeof(T), alignof(T) ) ) T( std::forward<A>( args )... );
+    }
+
+    // Everything allocated so far is gone; blocks are kept for reuse.
+    void reset() noexcept
+    {
+        current_ = first_;
+        cursor_  = end_ = 0;
+        if( current_ ) setCursor( current_ );
+    }
+
+    void enter() noexcept { ++depth_; }
+    void leave() noexcept { if( --depth_ == 0 ) reset(); }
+
+private:
+
+    static std::uintptr_t alignUp(std::uintptr_t p, std::size_t a) noexcept { return ( p + a - 1 ) & ~( a - 1 ); }
+
+    void setCursor(Block* b) noexcept
+    {
+        cursor_ = reinterpret_cast<std::uintptr_t>( b ) + header_size_;
+        end_    = reinterpret_cast<std::uintptr_t>( b ) + block_size_;
+    }
+
+    void nextBlock()
+    {
+        if( current_ && current_->next_ ) {
+            current_ = current_->next_;
+        } else {
+            auto b = new ( getFromPool<block_size_>() ) Block{ nullptr };
+            if( current_ ) current_->next_ = b;
+            else           first_ = b;
+            current_ = b;
+        }
+        setCursor( current_ );
+    }
+
+    Block*         first_;
+    Block*         current_;
+    std::uintptr_t cursor_;
+    std::uintptr_t end_;
+    std::size_t    depth_;
+};
+
+inline MessageArena& getMessageArena()
+{
+    thread_local MessageArena arena;
+    return arena;
+}
+
+// Marks the extent of one accept call. Only the outermost scope of a thread
+// rewinds the arena.
+class MessageArenaScope
+{
+public:
+
+    MessageArenaScope() noexcept : arena_{ getMessageArena() } { arena_.enter(); }
+    ~MessageArenaScope() { arena_.leave(); }
+
+    MessageArenaScope(const MessageArenaScope&)            = delete;
+    MessageArenaScope& operator=(const MessageArenaScope&) = delete;
+
+private:
+
+    MessageArena& arena_;
+};
+
+}
+
+#endif  // __MESSAGE_ARENA_RECONDUIT__HPP__
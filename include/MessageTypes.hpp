@@ -10,31 +10,26 @@
 
 namespace reconduits {
 
+// Messages are small values (a pointer to the embedded message plus, for
+// some kinds, the origin conduit), so the variant is three words at most and
+// building or copying one needs no memory from pools or arenas.
 template<typename T>
 using message_type = std::variant<
-                                  Setup<T>*,
-                                  Release<T>*,
-                                  Alerting<T>*,
-                                  InformationChunk<T>*
+                                  Setup<T>,
+                                  Release<T>,
+                                  Alerting<T>,
+                                  InformationChunk<T>
                                  >;
 
 constexpr auto make_variant_message(auto&& msg)
 {
-    return message_type<embedded_t<decltype( msg )>>{ &msg };
+    return message_type<embedded_t<decltype( msg )>>{ msg };
 }
 
 template<typename MSG>
-auto make_variant_message(auto&& msg, Conduit* conduit_origin)
+constexpr auto make_variant_message(auto&& msg, Conduit* conduit_origin)
 {
-    using msg_type = MSG;
-    thread_local static msg_type* msg_ptr;
-    if( msg_ptr ) {
-        msg_ptr->~msg_type();
-        new ( msg_ptr ) msg_type(msg.get(), conduit_origin);
-    } else {
-        msg_ptr = new msg_type(msg.get(), conduit_origin); // From Pool...
-    }
-    return message_type<embedded_t<decltype( msg )>>{ msg_ptr };
+    return message_type<embedded_t<decltype( msg )>>{ MSG{ msg.get(), conduit_origin } };
 }
 
 auto make_variant_setup_message(auto&& msg, Conduit* conduit_origin)
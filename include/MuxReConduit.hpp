@@ -3,9 +3,15 @@
 
 #include "ReConduitVisitors.hpp"
 #include "ReConduitPool.hpp"
+#include "BatchMessage.hpp"
 #include "ReConduitFwd.hpp"
+#include "RouteCache.hpp"
+#include "FlowAging.hpp"
+#include "MuxTable.hpp"
 
 #include <type_traits>
+#include <variant>
+#include <cstdint>
 
 namespace reconduits {
 
@@ -17,18 +23,41 @@ public:
     explicit Mux(T&& m)
         : conduit_to_side_a_{}
         , conduit_to_side_b0_{}
-        , mux_{ new ( getFromPool<sizeof(T)>() ) T{ std::forward<T>( m ) } }
+        , mux_{ new ( getFromPool<sizeof(T), alignof(T)>() ) T{ std::forward<T>( m ) } }
+        , routes_{}
+        , delete_routes_{}
+        , clear_routes_{}
+        , routes_key_{}
+    {
+        SPDLOG_DEBUG(getLogger(), "New Mux Conduit [{0:p}] created", static_cast<void*>(this));
+    }
+
+    // Adopts a user object already placed by its Conduit.
+    template<typename T>
+    explicit Mux(PlacedUser<T> placed)
+        : conduit_to_side_a_{}
+        , conduit_to_side_b0_{}
+        , mux_{ placed.user_ }
+        , routes_{}
+        , delete_routes_{}
+        , clear_routes_{}
+        , routes_key_{}
     {
         SPDLOG_DEBUG(getLogger(), "New Mux Conduit [{0:p}] created", static_cast<void*>(this));
     }
 
     Mux(Mux&& rhs)
-        : conduit_to_side_a_{ std::move( conduit_to_side_a_ ) }
-        , conduit_to_side_b0_{ std::move( conduit_to_side_b0_ ) }
+        : conduit_to_side_a_{ std::move( rhs.conduit_to_side_a_ ) }
+        , conduit_to_side_b0_{ std::move( rhs.conduit_to_side_b0_ ) }
         , mux_{ std::move( rhs.mux_ ) }
+        , routes_{ rhs.routes_ }
+        , delete_routes_{ rhs.delete_routes_ }
+        , clear_routes_{ rhs.clear_routes_ }
+        , routes_key_{ rhs.routes_key_ }
     {
         SPDLOG_DEBUG(getLogger(), "Mux Conduit [{0:p}] moved", static_cast<void*>(this));
         rhs.conduit_to_side_a_ = rhs.conduit_to_side_b0_ = nullptr;
+        rhs.routes_ = nullptr;
         auto move_mux = [ &rhs ](auto&& mux_ptr)
         {
             rhs.mux_ = static_cast<std::decay_t<decltype(mux_ptr)>>( nullptr );
@@ -44,10 +73,11 @@ public:
             if( mux_ptr ) {
                 using T = std::decay_t<decltype( *mux_ptr )>;
                 mux_ptr->~T();
-                putToPool<sizeof(T)>( mux_ptr );
+                putToPool<sizeof(T), alignof(T)>( mux_ptr );
             }
         };
         dispatch(mux_, delete_mux);
+        if( routes_ ) delete_routes_( routes_ );
     }
 
     Mux(const Mux& rhs)        = delete;
@@ -58,52 +88,304 @@ private:
 
     friend Conduit;
 
+    constexpr auto& user() noexcept { return mux_; }
+
     constexpr void setSideA(Conduit&  a) noexcept { conduit_to_side_a_  = &a; }
     constexpr void setSideB(Conduit& b0) noexcept { conduit_to_side_b0_ = &b0; }
     constexpr Conduit* insertInSideB(auto&& key, Conduit& b)
     {
-        auto insert = [ & ](auto&& mux_ptr) { return mux_ptr->insert(key, b); };
+        forgetFlow( key );
+        auto insert = [ & ](auto&& mux_ptr) -> Conduit*
+        {
+            if constexpr ( has_table<std::decay_t<decltype(*mux_ptr)>>::value ) {
+                auto& table = mux_ptr->table();
+                auto table_key = tableKeyOf<typename std::decay_t<decltype(table)>::key_type>( key );
+                return table_key ? table.route( *table_key, b ) : nullptr;
+            } else {
+                return mux_ptr->insert(key, b);
+            }
+        };
         return dispatch_r(mux_, insert);
     }
 
     constexpr Conduit* eraseFromSideB(auto&& key)
     {
-        auto erase = [ & ](auto&& mux_ptr) { return mux_ptr->erase( key ); };
+        forgetFlow( key );
+        auto erase = [ & ](auto&& mux_ptr) -> Conduit*
+        {
+            if constexpr ( has_table<std::decay_t<decltype(*mux_ptr)>>::value ) {
+                auto& table = mux_ptr->table();
+                auto table_key = tableKeyOf<typename std::decay_t<decltype(table)>::key_type>( key );
+                return table_key ? table.unroute( *table_key ) : nullptr;
+            } else {
+                return mux_ptr->erase( key );
+            }
+        };
         return dispatch_r(mux_, erase);
     }
 
-    constexpr auto accept(auto&& v_msg, Conduit* ctx_conduit)
+    // Route found in the table of a mux (see MuxTable.hpp) for the message
+    // it accepts, carried on to routing.
+    struct TableRoute
+    {
+        Conduit* next_;
+        bool     found_;
+        bool     looked_up_;
+    };
+
+    // Table entry of a message looked up along with the rest of its batch,
+    // good as long as the table stays at the same version. Keys not found are
+    // looked up again, as they may have been inserted since.
+    template<typename Entry>
+    struct BatchLookup
+    {
+        Entry         entry_;
+        std::uint64_t version_;
+    };
+
+    struct NoLookup {};
+
+    template<typename Lookup = NoLookup>
+    constexpr auto accept(auto v_msg, Conduit* ctx_conduit, const Lookup& lookup = {})
     {
         SPDLOG_DEBUG(getLogger(), "Mux Conduit [{:p}] with [a,b0] -> [{:p}, {:p}] accepts a new message.",
                 static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b0_));
-        auto accept = [ &ctx_conduit ](auto&& mux_ptr, auto&& msg_ptr) { return mux_ptr->accept(*msg_ptr, ctx_conduit); };
+        TableRoute route{};
+        auto accept = [ & ](auto&& mux_ptr, auto&& msg)
+        {
+            expireFlows(*mux_ptr, msg, ctx_conduit);
+            auto next = acceptMessage(*mux_ptr, msg, ctx_conduit, route, lookup);
+            forgetRoute(*mux_ptr, msg, next.second);
+            return next;
+        };
         auto [ next, next_v_msg ] = doubleDispatch_r(mux_, v_msg, accept);
         switch( next ) {
             case NextSide::a:  return std::pair{ conduit_to_side_a_, next_v_msg };
             case NextSide::b0: return std::pair{ conduit_to_side_b0_, next_v_msg };
-            default:           return selectConduitSideB(v_msg, ctx_conduit);
+            default:           return selectConduitSideB(v_msg, ctx_conduit, route);
+        }
+    }
+
+    // Every message is demultiplexed on its own and those going on as
+    // information chunks are regrouped by destination, the sub-batches being
+    // handed on to the walk. Any other message makes the pending sub-batches
+    // go first so that order within a flow is kept, and the rest of the batch
+    // comes back to the mux after it, once whatever it sets up or tears down
+    // is in place.
+    constexpr auto acceptBatch(auto batch, Conduit* ctx_conduit)
+    {
+        SPDLOG_DEBUG(getLogger(), "Mux Conduit [{:p}] with [a,b0] -> [{:p}, {:p}] accepts a batch of {} messages.",
+                static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b0_), batch.size());
+        using T = embedded_t<decltype(batch)>;
+        BatchPartitions<T> partitions{ batch.size() };
+        auto accept_all = [ & ](auto&& mux_ptr)
+        {
+            if constexpr ( has_mux_table<std::decay_t<decltype(*mux_ptr)>, InformationChunk<T>>::value ) {
+                return lookUpAndAccept(*mux_ptr, batch, ctx_conduit, partitions);
+            } else {
+                auto i = std::size_t{};
+                while( i < batch.size() && regroup(accept(message_type<T>{ InformationChunk<T>{ batch[ i++ ] } }, ctx_conduit), partitions) );
+                return i;
+            }
+        };
+        auto done = dispatch_r(mux_, accept_all);
+        partitions.flush();
+        if( done < batch.size() ) handOn( ctx_conduit, Batch<T>{ batch.begin() + done, batch.size() - done } );
+        return std::pair{ static_cast<Conduit*>( nullptr ), batch };
+    }
+
+    // Muxes with a table have their batches looked up a group at a time,
+    // through one find_many() call for all the keys of the group (see
+    // MuxTable.hpp), before the messages are accepted one by one. Returns how
+    // many were, up to the first one not going on as an information chunk.
+    template<typename U, typename T>
+    std::size_t lookUpAndAccept(U& mux, Batch<T> batch, Conduit* ctx_conduit, BatchPartitions<T>& partitions)
+    {
+        auto& table = mux.table();
+        using key_type   = typename std::decay_t<decltype(table)>::key_type;
+        using entry_type = decltype( table.find( std::declval<const key_type&>() ) );
+        key_type   keys[ mux_lookup_group ];
+        entry_type entries[ mux_lookup_group ];
+        for( auto first = std::size_t{}; first < batch.size(); first += mux_lookup_group ) {
+            auto n = std::min( mux_lookup_group, batch.size() - first );
+            for( auto i = std::size_t{}; i < n; ++i ) keys[ i ] = mux.routeKey( InformationChunk<T>{ batch[ first + i ] } );
+            if constexpr ( has_find_many<U, key_type, entry_type>::value ) mux.find_many(keys, n, entries);
+            else table.find_many(keys, n, entries);
+            auto version = table.version();
+            for( auto i = std::size_t{}; i < n; ++i ) {
+                auto lookup = BatchLookup<entry_type>{ entries[ i ], version };
+                if( ! regroup(accept(message_type<T>{ InformationChunk<T>{ batch[ first + i ] } }, ctx_conduit, lookup), partitions) ) {
+                    return first + i + 1;
+                }
+            }
         }
+        return batch.size();
     }
 
-    constexpr auto selectConduitSideB(auto&& v_msg, Conduit* ctx_conduit)
+    // False once a message goes on as anything but an information chunk,
+    // handed on after the pending sub-batches.
+    template<typename T>
+    static bool regroup(auto next, BatchPartitions<T>& partitions)
     {
-        auto find = [](auto&& mux_ptr, auto&& msg_ptr) { return mux_ptr->find( *msg_ptr ); };
-        if( auto [next_conduit, found] = doubleDispatch_r(mux_, v_msg, find); found ) {
+        auto [ next_conduit, next_v_msg ] = next;
+        if( next_conduit && std::holds_alternative<InformationChunk<T>>( next_v_msg ) ) {
+            partitions.add(next_conduit, &std::get<InformationChunk<T>>( next_v_msg ).get());
+            return true;
+        }
+        if( ! next_conduit ) return true;
+        partitions.flush();
+        handOn( next_conduit, next_v_msg );
+        return false;
+    }
+
+    constexpr auto selectConduitSideB(auto v_msg, Conduit* ctx_conduit, const TableRoute& route)
+    {
+        auto find = [ this ](auto&& mux_ptr, auto&& msg) { return findRoute(*mux_ptr, msg); };
+        auto [ next_conduit, found ] = route.looked_up_ ? std::pair{ route.next_, route.found_ } : doubleDispatch_r(mux_, v_msg, find);
+        if( found ) {
             SPDLOG_DEBUG(getLogger(), "Mux Conduit [{:p}] with [a,b] -> [{:p}, {:p}] is routing this message.",
                     static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(next_conduit));
             return std::pair{ next_conduit, v_msg };
         } else {
             SPDLOG_DEBUG(getLogger(), "Mux Conduit [{:p}] with [a,b0] -> [{:p}, {:p}] needs new route to be created.",
                 static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b0_));
-            auto setup = [ & ](auto&& mux_ptr, auto&& msg_ptr) { return mux_ptr->setup(*msg_ptr, ctx_conduit); };
+            auto setup = [ & ](auto&& mux_ptr, auto&& msg) { return setupRoute(*mux_ptr, msg, ctx_conduit); };
             auto setup_v_msg = doubleDispatch_r(mux_, v_msg, setup);
             return std::pair{ conduit_to_side_b0_, setup_v_msg };
         }
     }
 
+    // Route cache of muxes giving flow keys (see RouteCache.hpp). It is
+    // skipped over on a hit, and the route of a flow is dropped from it as
+    // soon as the flow is released or a factory changes it.
+    template<typename U, typename M>
+    using route_cache_t = RouteCache<std::decay_t<decltype( std::declval<const U&>().flowKey( std::declval<InformationChunk<embedded_t<M>>&>() ) )>>;
+
+    // Identity of the key type of the route cache, only known once the first
+    // message comes by.
+    template<typename Key>
+    static constexpr char route_key_tag{};
+
+    template<typename C>
+    C& routes()
+    {
+        if( ! routes_ ) {
+            routes_ = new ( getFromPool<sizeof(C), alignof(C)>() ) C{ getPoolResource() };
+            delete_routes_ = [](void* p) { static_cast<C*>( p )->~C(); putToPool<sizeof(C), alignof(C)>( p ); };
+            clear_routes_  = [](void* p) { static_cast<C*>( p )->clear(); };
+            routes_key_    = &route_key_tag<typename C::key_type>;
+        }
+        return *static_cast<C*>( routes_ );
+    }
+
+    // Factories name flows by the keys of the mux, or by variants holding
+    // them. The route cache is cleared for keys of any other type.
+    template<typename K>
+    void forgetFlow(const K& key)
+    {
+        using Key = std::decay_t<K>;
+        if( ! routes_ ) return;
+        if constexpr ( is_variant_v<Key> ) {
+            std::visit([ this ](auto&& k) { forgetFlow( k ); }, key);
+        } else if( routes_key_ == &route_key_tag<Key> ) {
+            static_cast<RouteCache<Key>*>( routes_ )->erase( key );
+        } else {
+            clear_routes_( routes_ );
+        }
+    }
+
+    template<typename U, typename M, typename Lookup>
+    auto acceptMessage(U& mux, M& msg, Conduit* ctx_conduit, TableRoute& route, const Lookup& lookup)
+    {
+        if constexpr ( has_mux_table<U, M>::value ) {
+            auto& table = mux.table();
+            auto entry = lookUp(table, mux.routeKey( msg ), lookup);
+            auto next = [ & ]
+            {
+                if constexpr ( has_entry_accept<U, M, decltype(entry)>::value ) return mux.accept(msg, ctx_conduit, entry);
+                else return mux.accept(msg, ctx_conduit);
+            }();
+            route = TableRoute{ entry ? table.nextOf( *entry ) : nullptr, entry != nullptr, true };
+            return next;
+        } else {
+            return mux.accept(msg, ctx_conduit);
+        }
+    }
+
+    template<typename Table, typename Key, typename Lookup>
+    static auto lookUp(Table& table, const Key& key, const Lookup& lookup)
+    {
+        if constexpr ( std::is_same_v<Lookup, BatchLookup<decltype( table.find( key ) )>> ) {
+            if( lookup.entry_ && lookup.version_ == table.version() ) return lookup.entry_;
+        }
+        return table.find( key );
+    }
+
+    template<typename U, typename M>
+    auto setupRoute(U& mux, M& msg, Conduit* ctx_conduit)
+    {
+        if constexpr ( has_setup<U, M>::value ) return mux.setup(msg, ctx_conduit);
+        else return make_variant_setup_message(msg, ctx_conduit);
+    }
+
+    template<typename U, typename M>
+    std::pair<Conduit*, bool> findRoute(U& mux, M& msg)
+    {
+        if constexpr ( has_mux_table<U, M>::value ) {
+            auto& table = mux.table();
+            auto entry = table.find( mux.routeKey( msg ) );
+            return { entry ? table.nextOf( *entry ) : nullptr, entry != nullptr };
+        } else if constexpr ( has_flow_key<U, M>::value ) {
+            auto& cache = routes<route_cache_t<U, M>>();
+            auto key = mux.flowKey( msg );
+            if( auto next = cache.find( key ) ) return { next, true };
+            auto [ next, found ] = mux.find( msg );
+            if( found && next ) cache.insert(key, next);
+            return { next, found };
+        } else {
+            auto [ next, found ] = mux.find( msg );
+            return { next, found };
+        }
+    }
+
+    // A flow being released, on its way in or out, loses its route.
+    template<typename U, typename M>
+    void forgetRoute(U& mux, M& msg, const auto& next_v_msg)
+    {
+        if constexpr ( has_flow_key<U, M>::value ) {
+            using release_type = Release<embedded_t<M>>;
+            if( routes_ && ( std::is_same_v<std::decay_t<M>, release_type> || std::holds_alternative<release_type>( next_v_msg ) ) ) {
+                routes<route_cache_t<U, M>>().erase( mux.flowKey( msg ) );
+            }
+        }
+    }
+
+    // Flows of aging muxes (see FlowAging.hpp) found idle are released through
+    // the factory on side B0, before the message in hand gets to the mux. The
+    // flow must be gone before the message is routed, so its release walks
+    // there and then, nested in the hop and counting on from its hops.
+    // Releases expire nothing themselves, so this nests one walk at most.
+    template<typename U, typename M>
+    void expireFlows(U& mux, M& msg, Conduit* ctx_conduit)
+    {
+        if constexpr ( has_flow_expiry<U, M>::value && std::is_same_v<M, InformationChunk<embedded_t<M>>> ) {
+            using T = embedded_t<M>;
+            if( ! conduit_to_side_b0_ ) return;
+            mux.expire( msg, [ & ](T& expired)
+            {
+                SPDLOG_DEBUG(getLogger(), "Mux Conduit [{:p}] releases an idle flow.", static_cast<void*>(this));
+                send( conduit_to_side_b0_, Release<T>{ expired, ctx_conduit } );
+            } );
+        }
+    }
+
     Conduit* conduit_to_side_a_;
     Conduit* conduit_to_side_b0_;
     mux_type mux_;
+    void*    routes_;
+    void   (*delete_routes_)(void*);
+    void   (*clear_routes_)(void*);
+    const char* routes_key_;
 };
 
 }
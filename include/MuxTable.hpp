@@ -0,0 +1,448 @@
+#ifndef __MUX_TABLE_RECONDUIT__HPP__
+#define __MUX_TABLE_RECONDUIT__HPP__
+
+#include "ReConduitFwd.hpp"
+#include "ReConduitMemoryResource.hpp"
+#include "ReConduitMagazine.hpp"
+#include "FlatFlowTable.hpp"
+#include "RouteCache.hpp"
+
+#include <memory_resource>
+#include <functional>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <limits>
+#include <optional>
+#include <variant>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Storage of keys small enough to index an array of Size values, such as
+// protocol numbers. Values must be default constructible.
+template<std::size_t Size = 256>
+struct DenseKeys
+{
+    template<typename Key, typename Value, typename Hash>
+    class storage
+    {
+    public:
+
+        using key_type    = Key;
+        using mapped_type = Value;
+
+        explicit storage(std::pmr::memory_resource* = nullptr) : values_{}, used_{}, version_{} {}
+
+        Value* find(const Key& key) noexcept
+        {
+            auto i = indexOf( key );
+            return i < Size && used_[ i ] ? &values_[ i ] : nullptr;
+        }
+
+        const Value* find(const Key& key) const noexcept { return const_cast<storage*>( this )->find( key ); }
+
+        void find_many(const Key* keys, std::size_t n, Value** found) noexcept
+        {
+            for( auto i = std::size_t{}; i < n; ++i ) found[ i ] = find( keys[ i ] );
+        }
+
+        std::uint64_t version() const noexcept { return version_; }
+
+        // Keys out of range are never stored.
+        template<typename... Args>
+        std::pair<Value*, bool> try_emplace(const Key& key, Args&&... args)
+        {
+            auto i = indexOf( key );
+            if( i >= Size ) return { nullptr, false };
+            if( used_[ i ] ) return { &values_[ i ], false };
+            values_[ i ] = Value{ std::forward<Args>( args )... };
+            used_.set( i );
+            return { &values_[ i ], true };
+        }
+
+        bool erase(const Key& key)
+        {
+            auto i = indexOf( key );
+            if( i >= Size || ! used_[ i ] ) return false;
+            values_[ i ] = Value{};
+            used_.reset( i );
+            ++version_;
+            return true;
+        }
+
+        std::size_t size() const noexcept { return used_.count(); }
+
+        void clear()
+        {
+            values_.fill( Value{} );
+            used_.reset();
+            ++version_;
+        }
+
+        template<typename F>
+        void forEach(F&& f)
+        {
+            for( auto i = std::size_t{}; i < Size; ++i ) {
+                if( used_[ i ] ) f( static_cast<Key>( i ), values_[ i ] );
+            }
+        }
+
+    private:
+
+        static std::size_t indexOf(const Key& key) noexcept { return static_cast<std::size_t>( key ); }
+
+        alignas(cache_line_size) std::array<Value, Size> values_;
+        std::bitset<Size> used_;
+        std::uint64_t version_;
+    };
+};
+
+// Storage of side B conduits directly indexed by keys below Size, such as IP
+// protocol numbers: one pointer per key, eight to a cache line, null where
+// there is no route, so that a lookup is a single load. Keys routed to a
+// default sink, such as protocols a factory has no conduits for, are found
+// the same way and never go back to the factory.
+template<std::size_t Size = 256>
+struct DirectIndex
+{
+    template<typename Key, typename Value, typename Hash>
+    class storage
+    {
+        static_assert(std::is_pointer_v<Value>, "Directly indexed values are conduit pointers, null for no route");
+
+    public:
+
+        using key_type    = Key;
+        using mapped_type = Value;
+
+        explicit storage(std::pmr::memory_resource* = nullptr) : conduits_{}, size_{}, version_{} {}
+
+        Value* find(const Key& key) noexcept
+        {
+            auto i = indexOf( key );
+            return i < Size && conduits_[ i ] ? &conduits_[ i ] : nullptr;
+        }
+
+        const Value* find(const Key& key) const noexcept { return const_cast<storage*>( this )->find( key ); }
+
+        void find_many(const Key* keys, std::size_t n, Value** found) noexcept
+        {
+            for( auto i = std::size_t{}; i < n; ++i ) found[ i ] = find( keys[ i ] );
+        }
+
+        std::uint64_t version() const noexcept { return version_; }
+
+        // Keys out of range and null conduits are never stored.
+        std::pair<Value*, bool> try_emplace(const Key& key, Value conduit)
+        {
+            auto i = indexOf( key );
+            if( i >= Size || ! conduit ) return { nullptr, false };
+            if( conduits_[ i ] ) return { &conduits_[ i ], false };
+            conduits_[ i ] = conduit;
+            ++size_;
+            return { &conduits_[ i ], true };
+        }
+
+        bool erase(const Key& key)
+        {
+            auto i = indexOf( key );
+            if( i >= Size || ! conduits_[ i ] ) return false;
+            conduits_[ i ] = nullptr;
+            --size_;
+            ++version_;
+            return true;
+        }
+
+        std::size_t size() const noexcept { return size_; }
+
+        void clear()
+        {
+            conduits_.fill( nullptr );
+            size_ = 0;
+            ++version_;
+        }
+
+        template<typename F>
+        void forEach(F&& f)
+        {
+            for( auto i = std::size_t{}; i < Size; ++i ) {
+                if( conduits_[ i ] ) f( static_cast<Key>( i ), conduits_[ i ] );
+            }
+        }
+
+    private:
+
+        static std::size_t indexOf(const Key& key) noexcept { return static_cast<std::size_t>( key ); }
+
+        alignas(cache_line_size) std::array<Value, Size> conduits_;
+        std::size_t   size_;
+        std::uint64_t version_;
+    };
+};
+
+// Storage of flows in a FlatFlowTable, growing as Rehash tells.
+template<typename Rehash = OneShotRehash>
+struct HashedKeys
+{
+    template<typename Key, typename Value, typename Hash>
+    using storage = FlatFlowTable<Key, Value, Hash, std::equal_to<Key>, Rehash>;
+};
+
+// Prefix of Length leading bits of an address.
+template<typename Address>
+struct Prefix
+{
+    Address      address_;
+    std::uint8_t length_;
+};
+
+// Storage of unsigned integer addresses found by longest prefix match, one
+// hash table per prefix length in use, tried from the longest one. Plain
+// keys are whole addresses, prefixes are stored and erased as such.
+struct LongestPrefix
+{
+    template<typename Key, typename Value, typename Hash>
+    class storage
+    {
+        static_assert(std::is_unsigned_v<Key>, "Longest prefix match is on unsigned integer addresses");
+
+        static constexpr std::size_t bits = std::numeric_limits<Key>::digits;
+        using table_type = FlatFlowTable<Key, Value, Hash>;
+
+    public:
+
+        using key_type    = Key;
+        using mapped_type = Value;
+
+        explicit storage(std::pmr::memory_resource* resource = getPoolResource())
+            : lengths_{}
+            , version_{}
+        {
+            for( auto& table : tables_ ) table = table_type{ resource };
+        }
+
+        Value* find(const Key& address) noexcept
+        {
+            for( auto lengths = lengths_; lengths.any(); ) {
+                auto length = longest( lengths );
+                if( auto value = tables_[ length ].find( maskOf( address, length ) ) ) return value;
+                lengths.reset( length );
+            }
+            return nullptr;
+        }
+
+        const Value* find(const Key& address) const noexcept { return const_cast<storage*>( this )->find( address ); }
+
+        void find_many(const Key* addresses, std::size_t n, Value** found) noexcept
+        {
+            for( auto i = std::size_t{}; i < n; ++i ) found[ i ] = find( addresses[ i ] );
+        }
+
+        std::uint64_t version() const noexcept { return version_; }
+
+        template<typename... Args>
+        std::pair<Value*, bool> try_emplace(const Key& address, Args&&... args)
+        {
+            return try_emplace( Prefix<Key>{ address, bits }, std::forward<Args>( args )... );
+        }
+
+        template<typename... Args>
+        std::pair<Value*, bool> try_emplace(const Prefix<Key>& prefix, Args&&... args)
+        {
+            auto length = std::min<std::size_t>( prefix.length_, bits );
+            lengths_.set( length );
+            ++version_;
+            return tables_[ length ].try_emplace( maskOf( prefix.address_, length ), std::forward<Args>( args )... );
+        }
+
+        bool erase(const Key& address) { return erase( Prefix<Key>{ address, bits } ); }
+
+        bool erase(const Prefix<Key>& prefix)
+        {
+            auto length = std::min<std::size_t>( prefix.length_, bits );
+            if( ! tables_[ length ].erase( maskOf( prefix.address_, length ) ) ) return false;
+            if( tables_[ length ].empty() ) lengths_.reset( length );
+            ++version_;
+            return true;
+        }
+
+        std::size_t size() const noexcept
+        {
+            auto n = std::size_t{};
+            for( auto& table : tables_ ) n += table.size();
+            return n;
+        }
+
+        void clear() noexcept
+        {
+            for( auto& table : tables_ ) table.clear();
+            lengths_.reset();
+            ++version_;
+        }
+
+        // Visits every prefix, longest ones first.
+        template<typename F>
+        void forEach(F&& f)
+        {
+            for( auto length = bits + 1; length--; ) {
+                tables_[ length ].forEach( [ & ](const Key& address, Value& value)
+                {
+                    f( Prefix<Key>{ address, static_cast<std::uint8_t>( length ) }, value );
+                } );
+            }
+        }
+
+    private:
+
+        static Key maskOf(Key address, std::size_t length) noexcept
+        {
+            return length ? static_cast<Key>( address & ( ~std::uintmax_t{} << ( bits - length ) ) ) : Key{};
+        }
+
+        static std::size_t longest(const std::bitset<bits + 1>& lengths) noexcept
+        {
+            auto length = bits;
+            while( ! lengths[ length ] ) --length;
+            return length;
+        }
+
+        std::array<table_type, bits + 1> tables_;
+        std::bitset<bits + 1> lengths_;
+        std::uint64_t version_;
+    };
+};
+
+// Routing table of a mux, its storage chosen by Policy. Values are either
+// the side B conduits themselves or per flow state holding it in a
+// next_conduit_ member:
+//
+//     MuxTable<ProtocolType, Conduit*, FlowHash<ProtocolType>, DirectIndex<256>>
+//     MuxTable<FiveTuple, FlowContext>
+//
+// Pointers to values last until the next change of the table.
+template<typename Key, typename Value, typename Hash = FlowHash<Key>, typename Policy = HashedKeys<>>
+class MuxTable : public Policy::template storage<Key, Value, Hash>
+{
+    using storage_type = typename Policy::template storage<Key, Value, Hash>;
+
+public:
+
+    using storage_type::storage_type;
+    using storage_type::find;
+    using storage_type::try_emplace;
+    using storage_type::erase;
+
+    MuxTable() : storage_type{ getPoolResource() } {}
+
+    bool empty() const noexcept { return this->size() == 0; }
+
+    // Side B conduit of the flow of key: the new one for conduit values, the
+    // one of the flow state already there otherwise.
+    Conduit* route(const Key& key, Conduit& next)
+    {
+        if constexpr ( std::is_same_v<Value, Conduit*> ) {
+            auto [ value, inserted ] = try_emplace( key, &next );
+            if( ! value ) return nullptr;
+            return *value = &next;
+        } else {
+            auto value = find( key );
+            return value ? value->next_conduit_ = &next : nullptr;
+        }
+    }
+
+    // Drops the flow of key, telling the side B conduit it had.
+    Conduit* unroute(const Key& key)
+    {
+        auto value = find( key );
+        if( ! value ) return nullptr;
+        auto next = nextOf( *value );
+        erase( key );
+        return next;
+    }
+
+    static Conduit* nextOf(const Value& value) noexcept
+    {
+        if constexpr ( std::is_same_v<Value, Conduit*> ) return value;
+        else return value.next_conduit_;
+    }
+};
+
+// Keys of a batch looked up at once by the Mux conduit of a mux with a table.
+constexpr std::size_t mux_lookup_group = 16;
+
+// Muxes opt in to being routed by the Mux conduit through their MuxTable by
+// giving it and the key of every message:
+//
+//     auto& table() noexcept { return table_; }
+//     auto routeKey(auto&& msg) const { return msg.get().getFlowId(); }
+//
+// The Mux conduit then looks the key up once per message, before the mux
+// accepts it, and, when they take it, hands the entry found (or nullptr) as
+// a third argument of accept, which must not erase it. Factories insert
+// and erase routes with keys of the table, or variants holding them. Muxes
+// may still give setup, otherwise a plain Setup message goes to side B0.
+//
+// Batches are looked up mux_lookup_group keys at a time through the
+// find_many() of the table, which for hashed storage prefetches the slots of
+// all of them before resolving any, so that their cache misses overlap.
+// Muxes may give their own:
+//
+//     void find_many(const Key* keys, std::size_t n, Value** entries);
+template<typename U, typename M, typename = void>
+struct has_mux_table : std::false_type {};
+
+template<typename U, typename M>
+struct has_mux_table<U, M, std::void_t<decltype( std::declval<U&>().table() ),
+                                       decltype( std::declval<const U&>().routeKey( std::declval<M&>() ) )>> : std::true_type {};
+
+template<typename U, typename = void>
+struct has_table : std::false_type {};
+
+template<typename U>
+struct has_table<U, std::void_t<decltype( std::declval<U&>().table() )>> : std::true_type {};
+
+template<typename U, typename M, typename E, typename = void>
+struct has_entry_accept : std::false_type {};
+
+template<typename U, typename M, typename E>
+struct has_entry_accept<U, M, E, std::void_t<decltype( std::declval<U&>().accept( std::declval<M&>(), std::declval<Conduit*>(), std::declval<E>() ) )>> : std::true_type {};
+
+template<typename U, typename M, typename = void>
+struct has_setup : std::false_type {};
+
+template<typename U, typename M>
+struct has_setup<U, M, std::void_t<decltype( std::declval<U&>().setup( std::declval<M&>(), std::declval<Conduit*>() ) )>> : std::true_type {};
+
+template<typename U, typename Key, typename Entry, typename = void>
+struct has_find_many : std::false_type {};
+
+template<typename U, typename Key, typename Entry>
+struct has_find_many<U, Key, Entry, std::void_t<decltype( std::declval<U&>().find_many( std::declval<const Key*>(), std::size_t{}, std::declval<Entry*>() ) )>> : std::true_type {};
+
+template<typename T> struct is_variant : std::false_type {};
+template<typename... T> struct is_variant<std::variant<T...>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_variant_v = is_variant<std::decay_t<T>>::value;
+
+// Key of the table out of the key given by a factory, none when a variant
+// holds another kind of key: the mux then has no route for it and its
+// messages keep going to side B0.
+template<typename Key, typename K>
+std::optional<Key> tableKeyOf(const K& key)
+{
+    if constexpr ( std::is_convertible_v<const K&, Key> ) {
+        return key;
+    } else {
+        if( auto table_key = std::get_if<Key>( &key ) ) return *table_key;
+        return std::nullopt;
+    }
+}
+
+}
+
+#endif  // __MUX_TABLE_RECONDUIT__HPP__
@@ -3,6 +3,8 @@
 
 #include "ReConduitVisitors.hpp"
 #include "ReConduitPool.hpp"
+#include "BatchMessage.hpp"
+#include "ReConduitFwd.hpp"
 
 #include <type_traits>
 
@@ -18,7 +20,17 @@ public:
     explicit Protocol(T&& p)
         : conduit_to_side_a_{}
         , conduit_to_side_b_{}
-        , protocol_{ new ( getFromPool<sizeof(T)>() ) T{ std::forward<T>( p ) } }
+        , protocol_{ new ( getFromPool<sizeof(T), alignof(T)>() ) T{ std::forward<T>( p ) } }
+    {
+        SPDLOG_DEBUG(getLogger(), "New Protocol Conduit [{0:p}] created", static_cast<void*>(this));
+    }
+
+    // Adopts a user object already placed by its Conduit.
+    template<typename T>
+    explicit Protocol(PlacedUser<T> placed)
+        : conduit_to_side_a_{}
+        , conduit_to_side_b_{}
+        , protocol_{ placed.user_ }
     {
         SPDLOG_DEBUG(getLogger(), "New Protocol Conduit [{0:p}] created", static_cast<void*>(this));
     }
@@ -46,7 +58,7 @@ public:
             if( protocol_ptr ) {
                 using T = std::decay_t<decltype(*protocol_ptr)>;
                 protocol_ptr->~T();
-                putToPool<sizeof(T)>( protocol_ptr );
+                putToPool<sizeof(T), alignof(T)>( protocol_ptr );
             }
         };
         dispatch(protocol_, delete_protocol);
@@ -60,16 +72,18 @@ private:
 
     friend Conduit;
 
+    constexpr auto& user() noexcept { return protocol_; }
+
     constexpr void setSideA(Conduit& a) noexcept { conduit_to_side_a_ = &a; }
     constexpr void setSideB(Conduit& b) noexcept { conduit_to_side_b_ = &b; }
 
-    constexpr auto accept(auto&& v_msg, Conduit* ctx_conduit)
+    constexpr auto accept(auto v_msg, Conduit* ctx_conduit)
     {
         SPDLOG_DEBUG(getLogger(), "Protocol Conduit [{:p}] with [a,b] -> [{:p}, {:p}] accepts a new message.",
                 static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b_));
-        auto accept = [ & ](auto&& protocol_ptr, auto&& msg_ptr)
+        auto accept = [ & ](auto&& protocol_ptr, auto&& msg)
         {
-            return protocol_ptr->accept(*msg_ptr, ctx_conduit);
+            return protocol_ptr->accept(msg, ctx_conduit);
         };
         auto [ next, next_v_msg ] = doubleDispatch_r(protocol_, v_msg, accept);
         switch( next )
@@ -80,6 +94,29 @@ private:
         }
     }
 
+    constexpr auto acceptBatch(auto batch, Conduit* ctx_conduit)
+    {
+        SPDLOG_DEBUG(getLogger(), "Protocol Conduit [{:p}] with [a,b] -> [{:p}, {:p}] accepts a batch of {} messages.",
+                static_cast<void*>(this), static_cast<void*>(conduit_to_side_a_), static_cast<void*>(conduit_to_side_b_), batch.size());
+        auto accept = [ & ](auto&& protocol_ptr)
+        {
+            using T = std::decay_t<decltype(*protocol_ptr)>;
+            if constexpr ( has_batch_accept_from<T, decltype(batch)>::value ) {
+                auto [ next, next_batch ] = protocol_ptr->acceptBatch(batch, ctx_conduit);
+                switch( next )
+                {
+                    case NextSide::a: return std::pair{ conduit_to_side_a_, next_batch };
+                    case NextSide::b: return std::pair{ conduit_to_side_b_, next_batch };
+                    default:          return std::pair{ static_cast<Conduit*>( nullptr ), next_batch };
+                }
+            } else {
+                ctx_conduit->acceptEach( batch );
+                return std::pair{ static_cast<Conduit*>( nullptr ), batch };
+            }
+        };
+        return dispatch_r(protocol_, accept);
+    }
+
     Conduit* conduit_to_side_a_;
     Conduit* conduit_to_side_b_;
     protocol_type protocol_;
@@ -0,0 +1,244 @@
+#ifndef __RECONDUIT_ARENA__HPP__
+#define __RECONDUIT_ARENA__HPP__
+
+#include "ReConduitLogger.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+constexpr std::size_t arena_huge_page_size = 2 * 1024 * 1024;
+
+struct PoolArenaConfig
+{
+    bool        huge_pages  = true;                     // MAP_HUGETLB, else THP
+    bool        prefault    = false;                    // MAP_POPULATE new regions
+    std::size_t region_size = 32 * arena_huge_page_size;
+};
+
+// Process wide source of slabs for the conduit pools.
+//
+// Large regions are mapped up front, backed by explicit huge pages
+// (MAP_HUGETLB) when the system has them reserved, or else by transparent
+// huge pages through madvise(MADV_HUGEPAGE). Slabs are power of two sized and
+// aligned to their own size, so the slab owning a block is found by masking
+// the block address. Released slabs are kept for reuse.
+class PoolArena
+{
+public:
+
+    static constexpr std::size_t huge_page_size = arena_huge_page_size;
+    static constexpr std::size_t min_slab_size  = 64 * 1024;
+
+    using Config = PoolArenaConfig;
+
+    struct Stats
+    {
+        std::size_t mapped_bytes;
+        std::size_t huge_tlb_bytes;
+        std::size_t slabs_in_use;
+        std::size_t slabs_free;
+        std::size_t released_bytes;
+    };
+
+    explicit PoolArena(Config cfg = {})
+        : cfg_{ cfg }
+        , cursor_{}
+        , end_{}
+        , free_slabs_{}
+        , regions_{}
+        , stats_{}
+    {}
+
+    PoolArena(const PoolArena&)            = delete;
+    PoolArena& operator=(const PoolArena&) = delete;
+
+    void configure(Config cfg)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        cfg_ = cfg;
+    }
+
+    // Slab of slab_size bytes (a power of two) aligned to slab_size.
+    void* allocate(std::size_t slab_size)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        auto& free_slab = free_slabs_[ indexOf( slab_size ) ];
+        if( free_slab ) {
+            auto slab = free_slab;
+            free_slab = free_slab->next_;
+            --stats_.slabs_free;
+            ++stats_.slabs_in_use;
+            return slab;
+        }
+        return carve( slab_size );
+    }
+
+    void deallocate(void* p, std::size_t slab_size) noexcept
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        push( p, slab_size );
+    }
+
+    // Like deallocate() but the slab pages, except the first one holding the
+    // free list link, are given back to the system. MAP_HUGETLB regions only
+    // give back whole huge pages, as madvise() cannot free part of one. THP
+    // regions give back small pages, the kernel splitting the huge page
+    // around them: slabs are much smaller than a huge page, which would
+    // otherwise never be given back. Only the bytes madvise() did give back
+    // are counted as released.
+    void release(void* p, std::size_t slab_size) noexcept
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        auto slab  = reinterpret_cast<std::uintptr_t>( p );
+        auto page  = pageSizeOf( slab );
+        auto first = alignUp( slab + pageSize(), page );
+        auto last  = alignDown( slab + slab_size, page );
+        if( first < last && ::madvise( reinterpret_cast<void*>( first ), last - first, MADV_DONTNEED ) == 0 ) {
+            stats_.released_bytes += last - first;
+        }
+        push( p, slab_size );
+    }
+
+    // Maps (and, if configured, prefaults) at least bytes of fresh arena
+    // so that the traffic ramp up does not pay for page faults.
+    void reserve(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        if( static_cast<std::size_t>( end_ - cursor_ ) < bytes ) mapRegion( bytes );
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        return stats_;
+    }
+
+private:
+
+    struct FreeSlab
+    {
+        FreeSlab* next_;
+    };
+
+    static constexpr std::size_t max_slab_shift_ = 40;
+
+    // Region mapped by the arena and the size of the pages backing it.
+    struct Region
+    {
+        std::uintptr_t begin_;
+        std::uintptr_t end_;
+        std::size_t    page_size_;
+    };
+
+    static std::size_t indexOf(std::size_t slab_size) noexcept
+    {
+        return static_cast<std::size_t>( __builtin_ctzll( slab_size ) );
+    }
+
+    static std::size_t pageSize() noexcept
+    {
+        static const auto page_size = static_cast<std::size_t>( ::sysconf( _SC_PAGESIZE ) );
+        return page_size;
+    }
+
+    std::size_t pageSizeOf(std::uintptr_t p) const noexcept
+    {
+        for( auto& region : regions_ ) {
+            if( p >= region.begin_ && p < region.end_ ) return region.page_size_;
+        }
+        return pageSize();
+    }
+
+    void push(void* p, std::size_t slab_size) noexcept
+    {
+        auto& free_slab = free_slabs_[ indexOf( slab_size ) ];
+        free_slab = new ( p ) FreeSlab{ free_slab };
+        --stats_.slabs_in_use;
+        ++stats_.slabs_free;
+    }
+
+    void* carve(std::size_t slab_size)
+    {
+        auto aligned = alignUp( cursor_, slab_size );
+        if( ! cursor_ || aligned + slab_size > end_ ) {
+            mapRegion( slab_size );
+            aligned = alignUp( cursor_, slab_size );
+        }
+        cursor_ = aligned + slab_size;
+        ++stats_.slabs_in_use;
+        return reinterpret_cast<void*>( aligned );
+    }
+
+    static std::uintptr_t alignUp(std::uintptr_t p, std::size_t a) noexcept { return ( p + a - 1 ) & ~( a - 1 ); }
+    static std::uintptr_t alignDown(std::uintptr_t p, std::size_t a) noexcept { return p & ~( a - 1 ); }
+
+    // The remainder of the current region is abandoned: slabs are at most a
+    // few hundred KiB while regions are tens of MiB.
+    void mapRegion(std::size_t at_least)
+    {
+        auto size  = alignUp( std::max( at_least, cfg_.region_size ), huge_page_size );
+        auto flags = MAP_PRIVATE | MAP_ANONYMOUS | ( cfg_.prefault ? MAP_POPULATE : 0 );
+
+        void* region = MAP_FAILED;
+        auto page_size = pageSize();
+        if( cfg_.huge_pages ) {
+            region = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0 );
+            if( region != MAP_FAILED ) {
+                stats_.huge_tlb_bytes += size;
+                page_size = huge_page_size;
+            }
+        }
+        if( region == MAP_FAILED ) {
+            // Over map by a huge page to align the region for THP.
+            auto raw = ::mmap( nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, flags, -1, 0 );
+            if( raw == MAP_FAILED ) throw std::bad_alloc();
+            auto begin = reinterpret_cast<std::uintptr_t>( raw );
+            auto start = alignUp( begin, huge_page_size );
+            if( start != begin ) ::munmap( raw, start - begin );
+            if( auto tail = huge_page_size - ( start - begin ) ) ::munmap( reinterpret_cast<void*>( start + size ), tail );
+            region = reinterpret_cast<void*>( start );
+            if( cfg_.huge_pages ) ::madvise( region, size, MADV_HUGEPAGE );
+        }
+        SPDLOG_DEBUG(getLogger(), "{}[{}] mapped region [{}] of {} bytes", __func__, static_cast<void*>(this), region, size);
+
+        stats_.mapped_bytes += size;
+        cursor_ = reinterpret_cast<std::uintptr_t>( region );
+        end_    = cursor_ + size;
+        regions_.push_back( Region{ cursor_, end_, page_size } );
+    }
+
+    mutable std::mutex mutex_;
+    Config             cfg_;
+    std::uintptr_t     cursor_;
+    std::uintptr_t     end_;
+    std::array<FreeSlab*, max_slab_shift_> free_slabs_;
+    std::vector<Region> regions_;
+    Stats              stats_;
+};
+
+// Never destroyed: static pools release their slabs during program exit,
+// after any arena with static storage duration would already be gone.
+inline PoolArena& getPoolArena()
+{
+    static auto arena = new PoolArena{};
+    return *arena;
+}
+
+inline void configurePoolArena(PoolArena::Config cfg)
+{
+    getPoolArena().configure( cfg );
+}
+
+}
+
+#endif //__RECONDUIT_ARENA__HPP__
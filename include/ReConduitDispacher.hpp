@@ -5,11 +5,94 @@
 #include "ReConduitVisitors.hpp"
 #include "ReConduitLogger.hpp"
 #include "ReConduitPool.hpp"
+#include "MessageArena.hpp"
+#include "BatchMessage.hpp"
 
 #include <type_traits>
+#include <variant>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+// Longest path a message may take before it is taken for a loop and dropped.
+#ifndef RECONDUIT_MAX_HOPS
+#define RECONDUIT_MAX_HOPS 1024
+#endif
+
+// Per hop instrumentation, given the conduit about to accept the message, the
+// message (a message_type variant or a Batch) and the hops made so far.
+#ifndef RECONDUIT_ON_HOP
+#define RECONDUIT_ON_HOP( conduit, message, hops )
+#endif
+
+// Keeps every conduit, its links and its user object in one cache line
+// aligned block. Set to 0 to allocate the user object on its own.
+#ifndef RECONDUIT_SINGLE_BLOCK_CONDUITS
+#define RECONDUIT_SINGLE_BLOCK_CONDUITS 1
+#endif
 
 namespace reconduits {
 
+// Storage of a conduit of kind K (Protocol, Mux...) wrapping a user object
+// of type U. User objects which cannot be moved stay where the kind put them.
+template<typename K, typename U>
+struct ConduitLayout
+{
+    static constexpr bool single_block = RECONDUIT_SINGLE_BLOCK_CONDUITS && std::is_move_constructible_v<U>;
+
+    static constexpr std::size_t user_offset = roundUp(sizeof(K), alignof(U));
+    static constexpr std::size_t size        = single_block ? user_offset + sizeof(U) : sizeof(K);
+    static constexpr std::size_t alignment   = single_block ? std::max(cache_line_size, alignof(U)) : alignof(K);
+};
+
+// Per thread state of the walks of messages embedding T. Hops hand work on
+// to the walk running them rather than accepting it themselves (see
+// Conduit::handOn()), so that the stack stays as deep whatever the path.
+// What the hop running now hands on is kept in order, then put on top of the
+// work left, which walks take from the top: it all runs in the order nested
+// accept calls would have run it.
+template<typename T>
+struct Walks
+{
+    struct Pending
+    {
+        Conduit*                                next_;
+        std::variant<message_type<T>, Batch<T>> message_;
+        std::size_t                             hops_;
+        Pending*                                below_;
+    };
+
+    Pending*    top_;       // next work to run, of the innermost walk first
+    Pending*    handed_;    // handed on by the hop running now
+    Pending*    last_;      // last of handed_
+    std::size_t hops_;      // made before the hop running now
+    std::size_t running_;   // walks in progress, nested ones included
+
+    void handOn(Conduit* next, std::variant<message_type<T>, Batch<T>> message, std::size_t hops)
+    {
+        auto pending = getMessageArena().make<Pending>( Pending{ next, message, hops, nullptr } );
+        if( handed_ ) last_->below_ = pending;
+        else          handed_ = pending;
+        last_ = pending;
+    }
+
+    void pushHanded() noexcept
+    {
+        if( ! handed_ ) return;
+        last_->below_ = top_;
+        top_ = handed_;
+        handed_ = last_ = nullptr;
+    }
+};
+
+template<typename T>
+inline Walks<T>& walksOf() noexcept
+{
+    thread_local Walks<T> walks{};
+    return walks;
+}
+
 class Conduit
 {
 public:
@@ -21,7 +104,20 @@ public:
 
     template<typename T, typename = std::enable_if_t< ! std::is_same_v<std::decay_t<T>, Conduit> > >
     explicit Conduit(T&& c)
-        : conduit_{ new ( getFromPool<sizeof(T)>() ) T{ std::forward<T>( c ) } }
+        : conduit_{ makeConduit( std::forward<T>( c ) ) }
+    {
+        SPDLOG_DEBUG(getLogger(), "New Conduit [{0:p}] created", static_cast<void*>(this));
+    }
+
+    // Conduit of kind K built right around its user object:
+    //
+    //     Conduit{ std::in_place_type<Protocol>, TCPProtocol{} }
+    //
+    // saves the pool block and the move Conduit{ Protocol{ TCPProtocol{} } }
+    // pays for its user object, which matters for per flow conduits.
+    template<typename K, typename U>
+    Conduit(std::in_place_type_t<K> kind, U&& user)
+        : conduit_{ makeConduit( kind, std::forward<U>( user ) ) }
     {
         SPDLOG_DEBUG(getLogger(), "New Conduit [{0:p}] created", static_cast<void*>(this));
     }
@@ -31,9 +127,19 @@ public:
         auto delete_conduit = [ & ](auto&& conduit_ptr)
         {
             SPDLOG_DEBUG(getLogger(), "Deleting Conduit [{0:p}] with variant pointer [{1:p}]", static_cast<void*>(this), static_cast<void*>(conduit_ptr));
-            using T = std::decay_t<decltype(*conduit_ptr)>;
-            conduit_ptr->~T();
-            putToPool<sizeof(T)>( conduit_ptr );
+            using K = std::decay_t<decltype(*conduit_ptr)>;
+            auto delete_user = [ & ](auto&& user_ptr)
+            {
+                using U = std::decay_t<decltype(*user_ptr)>;
+                using layout = ConduitLayout<K, U>;
+                if constexpr ( layout::single_block ) {
+                    if( user_ptr ) user_ptr->~U();
+                    conduit_ptr->user() = static_cast<U*>( nullptr );
+                }
+                conduit_ptr->~K();
+                putToPool<layout::size, layout::alignment>( conduit_ptr );
+            };
+            dispatch(conduit_ptr->user(), delete_user);
         };
         dispatch(conduit_, delete_conduit);
     }
@@ -63,20 +169,154 @@ public:
 
     constexpr void accept(auto&& msg)
     {
-        auto v_msg = make_variant_message( msg );
-        auto accept = [ & ](auto&& conduit_ptr) { return conduit_ptr->accept(v_msg, this); };
-        auto [ next_conduit, next_v_msg ] = dispatch_r(conduit_, accept);
-        if( next_conduit ) {
-            auto move_next = [ & ](auto&& message_ptr) { next_conduit->accept( *message_ptr ); };
-            dispatch(next_v_msg, move_next);
-        }
+        MessageArenaScope scope;
+        using T = embedded_t<decltype(msg)>;
+        if constexpr ( is_batch_v<decltype(msg)> ) walk<T>( msg );
+        else walk<T>( make_variant_message( msg ) );
+    }
+
+    // Fallback for conduits that cannot take a batch as a whole: its
+    // messages come back to this conduit one by one once the hop is over.
+    template<typename T>
+    void acceptEach(Batch<T> batch)
+    {
+        for( auto m : batch ) handOn( this, message_type<T>{ InformationChunk<T>{ *m } } );
+    }
+
+    // Message for next to accept once the hop running now is over, after
+    // what it handed on before, as one more hop of the walk running it.
+    // Outside of any walk, next accepts it right away.
+    template<typename T>
+    static void handOn(Conduit* next, message_type<T> message)
+    {
+        auto& walks = walksOf<T>();
+        if( walks.running_ ) return walks.handOn( next, message, walks.hops_ + 1 );
+        std::visit([ next ](auto&& m) { next->accept( m ); }, message);
+    }
+
+    template<typename T>
+    static void handOn(Conduit* next, Batch<T> batch)
+    {
+        auto& walks = walksOf<T>();
+        if( walks.running_ ) return walks.handOn( next, batch, walks.hops_ + 1 );
+        next->accept( batch );
     }
 
 private:
 
+    // The kind wrapper (Protocol, Mux...) is moved to its final block and,
+    // in single block storage, the user object it got is moved right behind
+    // it, so that a hop touches one allocation instead of three.
+    template<typename T>
+    static conduit_type makeConduit(T&& c)
+    {
+        using K = std::decay_t<T>;
+        auto make_conduit = [ & ](auto&& user_ptr) -> conduit_type
+        {
+            using U = std::decay_t<decltype(*user_ptr)>;
+            using layout = ConduitLayout<K, U>;
+            auto block = static_cast<std::byte*>( getFromPool<layout::size, layout::alignment>() );
+            auto conduit_ptr = new ( block ) K{ std::forward<T>( c ) };
+            if constexpr ( layout::single_block ) {
+                if( user_ptr ) {
+                    conduit_ptr->user() = new ( block + layout::user_offset ) U{ std::move( *user_ptr ) };
+                    user_ptr->~U();
+                    putToPool<sizeof(U), alignof(U)>( user_ptr );
+                }
+            }
+            return conduit_ptr;
+        };
+        return dispatch_r(c.user(), make_conduit);
+    }
+
+    template<typename K, typename U>
+    static conduit_type makeConduit(std::in_place_type_t<K>, U&& user)
+    {
+        using T = std::decay_t<U>;
+        using layout = ConduitLayout<K, T>;
+        auto block = static_cast<std::byte*>( getFromPool<layout::size, layout::alignment>() );
+        auto user_ptr = [ & ]
+        {
+            if constexpr ( layout::single_block ) return new ( block + layout::user_offset ) T{ std::forward<U>( user ) };
+            else return new ( getFromPool<sizeof(T), alignof(T)>() ) T{ std::forward<U>( user ) };
+        }();
+        return new ( block ) K{ PlacedUser<T>{ user_ptr } };
+    }
+
+    // Trampoline carrying the message from conduit to conduit in a loop, then
+    // whatever hops handed on meanwhile, so the stack does not grow with the
+    // length of the path nor with batches splitting on the way. Walks nested
+    // in a hop, for messages a user object sends on by itself, carry on
+    // counting the hops of the walk they are nested in.
+    template<typename T, typename M>
+    void walk(M message)
+    {
+        auto& walks = walksOf<T>();
+        auto floor  = walks.top_;
+        auto nested = walks.running_ != 0;
+        auto outer  = std::tuple{ walks.handed_, walks.last_, walks.hops_ };
+        walks.handed_ = walks.last_ = nullptr;
+        ++walks.running_;
+        struct Leave
+        {
+            Walks<T>& walks_;
+            decltype(outer) outer_;
+            ~Leave()
+            {
+                --walks_.running_;
+                std::tie( walks_.handed_, walks_.last_, walks_.hops_ ) = outer_;
+            }
+        } leave{ walks, outer };
+
+        run( this, message, nested ? walks.hops_ + 1 : 0, walks );
+        while( walks.top_ != floor ) {
+            auto pending = walks.top_;
+            walks.top_ = pending->below_;
+            std::visit([ & ](auto&& m) { run( pending->next_, m, pending->hops_, walks ); }, pending->message_);
+        }
+    }
+
+    template<typename T, typename M>
+    static void run(Conduit* conduit, M message, std::size_t hops, Walks<T>& walks)
+    {
+        for( ; conduit; ++hops ) {
+            if( hops >= RECONDUIT_MAX_HOPS ) {
+                getLogger()->warn("Message dropped at Conduit [{:p}] after {} hops, the graph may have a loop.", static_cast<void*>(conduit), hops);
+                return;
+            }
+            RECONDUIT_ON_HOP( conduit, message, hops );
+            walks.hops_ = hops;
+            auto accept = [ & ](auto&& conduit_ptr)
+            {
+                if constexpr ( is_batch_v<M> ) return conduit_ptr->acceptBatch(message, conduit);
+                else return conduit_ptr->accept(message, conduit);
+            };
+            std::tie( conduit, message ) = dispatch_r(conduit->conduit_, accept);
+            walks.pushHanded();
+            if constexpr ( is_batch_v<M> ) {
+                if( message.empty() ) return;
+            }
+        }
+    }
+
     conduit_type conduit_;
 };
 
+template<typename T>
+void BatchPartitions<T>::flush(Partition& p)
+{
+    Conduit::handOn( p.next_, Batch<T>{ p.items_, p.size_ } );
+    p.items_ = nullptr;
+    p.size_ = 0;
+}
+
+template<typename T>
+void BatchPartitions<T>::flush()
+{
+    for( auto p = partitions_; p != partitions_ + used_; ++p ) flush( *p );
+    used_ = 0;
+}
+
 }
 
 #endif  // __RECONDUIT_DISPACHER__HPP__
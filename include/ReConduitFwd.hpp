@@ -9,6 +9,24 @@ enum class NextSide { done, a, b, b0 };
 
 class Conduit; // Forward declaration
 
+// Message sent on to a conduit from the headers of its kinds and user
+// objects, where Conduit is only complete once the conduit types are
+// generated.
+template<typename C>
+constexpr void send(C* conduit, auto&& message) { conduit->accept( message ); }
+
+// Same for messages handed on to the walk running the hop (see
+// Conduit::handOn()).
+template<typename C>
+constexpr void handOn(C* conduit, auto&& message) { C::handOn( conduit, message ); }
+
+// User object already placed by a Conduit, adopted as is by its kind.
+template<typename U>
+struct PlacedUser
+{
+    U* user_;
+};
+
 }
 
 #endif // __RECONDUIT_COMMONS__HPP__
@@ -0,0 +1,251 @@
+#ifndef __RECONDUIT_MAGAZINE__HPP__
+#define __RECONDUIT_MAGAZINE__HPP__
+
+#include "ReConduitLogger.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Magazine layer in front of a slab pool (Bonwick & Adams, "Magazines and
+// Vmem", 2001).
+//
+// Every thread keeps two magazines per pool and serves get()/put() from them
+// without synchronization. Only when both are empty (or both are full) a whole
+// magazine is exchanged with the depot, whose stacks are lock-free. The slab
+// behind the depot is reached under a mutex just to fill brand new magazines.
+
+constexpr std::size_t cache_line_size = 64;
+
+struct alignas(cache_line_size) Magazine
+{
+    static constexpr std::size_t capacity = 32;
+
+    constexpr bool empty() const noexcept { return rounds_ == 0; }
+    constexpr bool full() const noexcept { return rounds_ == capacity; }
+
+    void* pop() noexcept { return round_[ --rounds_ ]; }
+    void push(void* p) noexcept { round_[ rounds_++ ] = p; }
+
+    std::atomic<Magazine*> next_{};
+    std::size_t rounds_{};
+    void* round_[ capacity ];
+};
+
+// Treiber stack of magazines. The head packs a 16 bit version tag above the
+// 48 bit user space address to defeat ABA: magazines are recycled but never
+// released while the depot is alive, so reading next_ on a stale head is safe.
+// Magazines whose address does not fit in 48 bits (57 bit address spaces)
+// go to a second stack under a mutex instead.
+class MagazineStack
+{
+    static_assert(sizeof(void*) == sizeof(std::uint64_t), "MagazineStack needs 64 bit pointers");
+
+    static constexpr unsigned      tag_shift_    = 48;
+    static constexpr std::uint64_t pointer_mask_ = ( std::uint64_t{1} << tag_shift_ ) - 1;
+
+    static Magazine* pointerOf(std::uint64_t head) noexcept { return reinterpret_cast<Magazine*>( head & pointer_mask_ ); }
+    static std::uint64_t nextTag(std::uint64_t head) noexcept { return ( ( head >> tag_shift_ ) + 1 ) << tag_shift_; }
+    static std::uint64_t pack(Magazine* m, std::uint64_t tag) noexcept { return reinterpret_cast<std::uint64_t>( m ) | tag; }
+
+public:
+
+    MagazineStack() = default;
+    MagazineStack(const MagazineStack&)            = delete;
+    MagazineStack& operator=(const MagazineStack&) = delete;
+
+    static bool packable(const Magazine* m) noexcept { return ( reinterpret_cast<std::uint64_t>( m ) & ~pointer_mask_ ) == 0; }
+
+    void push(Magazine* m) noexcept
+    {
+        if( ! packable( m ) ) return pushLocked( m );
+        auto head = head_.load( std::memory_order_relaxed );
+        std::uint64_t new_head;
+        do {
+            m->next_.store( pointerOf( head ), std::memory_order_relaxed );
+            new_head = pack( m, nextTag( head ) );
+        } while( ! head_.compare_exchange_weak( head, new_head, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    // Only packable magazines are linked into the lock-free stack, so next_
+    // always fits there.
+    Magazine* pop() noexcept
+    {
+        auto head = head_.load( std::memory_order_acquire );
+        while( auto m = pointerOf( head ) ) {
+            auto new_head = pack( m->next_.load( std::memory_order_relaxed ), nextTag( head ) );
+            if( head_.compare_exchange_weak( head, new_head, std::memory_order_acquire, std::memory_order_acquire ) ) return m;
+        }
+        return wide_.load( std::memory_order_relaxed ) ? popLocked() : nullptr;
+    }
+
+private:
+
+    void pushLocked(Magazine* m) noexcept
+    {
+        std::lock_guard<std::mutex> lock{ wide_mutex_ };
+        m->next_.store( wide_.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        wide_.store( m, std::memory_order_relaxed );
+    }
+
+    Magazine* popLocked() noexcept
+    {
+        std::lock_guard<std::mutex> lock{ wide_mutex_ };
+        auto m = wide_.load( std::memory_order_relaxed );
+        if( m ) wide_.store( m->next_.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        return m;
+    }
+
+    std::atomic<std::uint64_t> head_{};
+    std::atomic<Magazine*> wide_{};
+    std::mutex wide_mutex_;
+};
+
+// Process wide depot for one slab pool. Magazines move between threads only as
+// a whole, so a block freed on one thread and reused on another costs a single
+// depot exchange every Magazine::capacity operations.
+template<typename Pool>
+class MagazineDepot
+{
+public:
+
+    explicit MagazineDepot(std::size_t n = 0)
+        : slab_{ n }
+    {}
+
+    ~MagazineDepot()
+    {
+        while( auto m = full_.pop() )  delete m;
+        while( auto m = empty_.pop() ) delete m;
+    }
+
+    MagazineDepot(const MagazineDepot&)            = delete;
+    MagazineDepot& operator=(const MagazineDepot&) = delete;
+
+    Magazine* popFull() noexcept { return full_.pop(); }
+    void pushFull(Magazine* m) noexcept { full_.push( m ); }
+
+    Magazine* popEmpty()
+    {
+        if( auto m = empty_.pop() ) return m;
+        return new Magazine{};
+    }
+    void pushEmpty(Magazine* m) noexcept { empty_.push( m ); }
+
+    void fill(Magazine& m)
+    {
+        std::lock_guard<std::mutex> lock{ slab_mutex_ };
+        while( ! m.full() ) m.push( slab_.get() );
+    }
+
+    // Slow paths for threads whose magazine cache is already gone.
+    void* get()
+    {
+        std::lock_guard<std::mutex> lock{ slab_mutex_ };
+        return slab_.get();
+    }
+
+    void put(void* p)
+    {
+        std::lock_guard<std::mutex> lock{ slab_mutex_ };
+        slab_.put( p );
+    }
+
+    // Returns the blocks parked in full depot magazines to the slab and lets
+    // it give its free slabs back down to its low watermark. Blocks cached by
+    // the threads themselves are left alone.
+    std::size_t reclaim()
+    {
+        while( auto m = full_.pop() ) {
+            {
+                std::lock_guard<std::mutex> lock{ slab_mutex_ };
+                while( ! m->empty() ) slab_.put( m->pop() );
+            }
+            empty_.push( m );
+        }
+        std::lock_guard<std::mutex> lock{ slab_mutex_ };
+        return slab_.trim( slab_.watermarks().low );
+    }
+
+    template<typename F>
+    decltype(auto) withSlab(F&& f)
+    {
+        std::lock_guard<std::mutex> lock{ slab_mutex_ };
+        return std::forward<F>( f )( slab_ );
+    }
+
+private:
+
+    alignas(cache_line_size) MagazineStack full_;
+    alignas(cache_line_size) MagazineStack empty_;
+    alignas(cache_line_size) std::mutex slab_mutex_;
+    Pool slab_;
+};
+
+// Per thread pair of magazines in front of a depot.
+template<typename Depot>
+class MagazineCache
+{
+public:
+
+    explicit MagazineCache(Depot& depot)
+        : depot_{ depot }
+        , loaded_{ depot.popEmpty() }
+        , previous_{ depot.popEmpty() }
+    {}
+
+    ~MagazineCache()
+    {
+        for( auto m : { loaded_, previous_ } ) {
+            if( m->empty() ) depot_.pushEmpty( m );
+            else             depot_.pushFull( m );
+        }
+    }
+
+    MagazineCache(const MagazineCache&)            = delete;
+    MagazineCache& operator=(const MagazineCache&) = delete;
+
+    void* get()
+    {
+        if( loaded_->empty() ) {
+            if( ! previous_->empty() ) {
+                std::swap( loaded_, previous_ );
+            } else if( auto full = depot_.popFull() ) {
+                depot_.pushEmpty( previous_ );
+                previous_ = loaded_;
+                loaded_ = full;
+            } else {
+                depot_.fill( *loaded_ );
+            }
+        }
+        return loaded_->pop();
+    }
+
+    void put(void* p)
+    {
+        if( loaded_->full() ) {
+            if( ! previous_->full() ) {
+                std::swap( loaded_, previous_ );
+            } else {
+                depot_.pushFull( previous_ );
+                previous_ = loaded_;
+                loaded_ = depot_.popEmpty();
+            }
+        }
+        loaded_->push( p );
+    }
+
+private:
+
+    Depot&    depot_;
+    Magazine* loaded_;
+    Magazine* previous_;
+};
+
+}
+
+#endif //__RECONDUIT_MAGAZINE__HPP__
@@ -0,0 +1,143 @@
+#ifndef __RECONDUIT_MEMORY_RESOURCE__HPP__
+#define __RECONDUIT_MEMORY_RESOURCE__HPP__
+
+#include "ReConduitPool.hpp"
+
+#include <memory_resource>
+#include <utility>
+#include <array>
+#include <cstddef>
+
+namespace reconduits {
+
+// Size classes served by PoolResource. Larger requests go to the upstream
+// resource.
+constexpr std::size_t pool_resource_max_size = 4096;
+
+constexpr std::size_t sizeClassCount(std::size_t max_size = pool_resource_max_size) noexcept
+{
+    auto n = std::size_t{};
+    for( auto c = nextSizeClass( 0 ); c <= max_size; c = nextSizeClass( c ) ) ++n;
+    return n;
+}
+
+constexpr std::size_t sizeClassAt(std::size_t index) noexcept
+{
+    auto c = nextSizeClass( 0 );
+    while( index-- ) c = nextSizeClass( c );
+    return c;
+}
+
+// O(1) inverse of sizeClassAt() for the smallest class holding size bytes.
+constexpr std::size_t sizeClassIndexOf(std::size_t size) noexcept
+{
+    if( size <= 128 ) return size ? ( size - 1 ) / min_block_alignment : 0;
+    auto group = std::size_t{128};
+    auto index = std::size_t{8};
+    while( group * 2 < size ) { group *= 2; index += 4; }
+    return index + ( size - group - 1 ) / ( group / 4 );
+}
+
+// Runtime entry points of the size class pools, indexed by class.
+template<std::size_t... I>
+constexpr auto makeSizeClasses(std::index_sequence<I...>) noexcept
+{
+    return std::array<std::size_t, sizeof...(I)>{ sizeClassAt(I)... };
+}
+
+template<std::size_t... I>
+constexpr auto makePoolGetters(std::index_sequence<I...>) noexcept
+{
+    using get_type = void* (*)();
+    return std::array<get_type, sizeof...(I)>{ &getFromPool<sizeClassAt(I), naturalAlignmentOf(sizeClassAt(I))>... };
+}
+
+template<std::size_t... I>
+constexpr auto makePoolPutters(std::index_sequence<I...>) noexcept
+{
+    using put_type = void (*)(void*);
+    return std::array<put_type, sizeof...(I)>{ &putToPool<sizeClassAt(I), naturalAlignmentOf(sizeClassAt(I))>... };
+}
+
+// The conduit pools seen as a std::pmr::memory_resource, so that the state
+// of user conduits (containers, strings...) allocates from the same size
+// classes, magazines and huge page arena as the conduits themselves.
+class PoolResource : public std::pmr::memory_resource
+{
+    static constexpr std::size_t classes_ = sizeClassCount();
+
+    static constexpr auto class_sizes_ = makeSizeClasses( std::make_index_sequence<classes_>{} );
+    static constexpr auto getters_     = makePoolGetters( std::make_index_sequence<classes_>{} );
+    static constexpr auto putters_     = makePoolPutters( std::make_index_sequence<classes_>{} );
+
+    // Class index honouring alignment, or classes_ when the pools cannot serve it.
+    static std::size_t indexOf(std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if( bytes > pool_resource_max_size || alignment > max_block_alignment ) return classes_;
+        auto index = sizeClassIndexOf( std::max( bytes, alignment ) );
+        while( index < classes_ && class_sizes_[ index ] % alignment ) ++index;
+        return index;
+    }
+
+public:
+
+    explicit PoolResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) noexcept
+        : upstream_{ upstream }
+    {}
+
+private:
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        auto index = indexOf( bytes, alignment );
+        return index < classes_ ? getters_[ index ]() : upstream_->allocate( bytes, alignment );
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        auto index = indexOf( bytes, alignment );
+        if( index < classes_ ) putters_[ index ]( p );
+        else upstream_->deallocate( p, bytes, alignment );
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        auto rhs = dynamic_cast<const PoolResource*>( &other );
+        return rhs && rhs->upstream_->is_equal( *upstream_ );
+    }
+
+    std::pmr::memory_resource* upstream_;
+};
+
+inline PoolResource* getPoolResource()
+{
+    static PoolResource resource;
+    return &resource;
+}
+
+// Monotonic arena whose buffers come from the conduit pools. Meant to live as
+// long as a message or a flow: everything allocated from it is given back at
+// once when the arena goes away (e.g. when the flow is released).
+class MonotonicArena : public std::pmr::monotonic_buffer_resource
+{
+public:
+
+    explicit MonotonicArena(std::size_t initial_size = 1024, std::pmr::memory_resource* upstream = getPoolResource())
+        : std::pmr::monotonic_buffer_resource{ initial_size, upstream }
+    {}
+};
+
+// Pooled resource for state shared by a whole conduit graph. It is not
+// synchronized, as a graph is driven by one thread at a time.
+class GraphResource : public std::pmr::unsynchronized_pool_resource
+{
+public:
+
+    explicit GraphResource(std::pmr::memory_resource* upstream = getPoolResource())
+        : std::pmr::unsynchronized_pool_resource{ upstream }
+    {}
+};
+
+}
+
+#endif //__RECONDUIT_MEMORY_RESOURCE__HPP__
@@ -2,88 +2,483 @@
 #define __RECONDUIT_POOL__HPP__
 
 #include "ReConduitLogger.hpp"
+#include "ReConduitMagazine.hpp"
+#include "ReConduitArena.hpp"
 
 #include <memory>
-#include <forward_list>
-#include <unordered_set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cassert>
 
 namespace reconduits {
 
+constexpr std::size_t min_block_alignment = alignof(std::max_align_t);
+constexpr std::size_t max_block_alignment = 4096;
+
+constexpr std::size_t roundUp(std::size_t n, std::size_t a) noexcept { return ( n + a - 1 ) / a * a; }
+
+// Largest power of two dividing n, i.e. the alignment every block of an array
+// of n sized blocks keeps when the array itself is aligned to it.
+constexpr std::size_t naturalAlignmentOf(std::size_t n) noexcept
+{
+    return std::min( n & ( ~n + 1 ), max_block_alignment );
+}
+
+// Size classes a la jemalloc: multiples of 16 bytes up to 128 and then four
+// evenly spaced classes per power of two, so that no more than 20% of a block
+// is lost to rounding. Every power of two is a class.
+constexpr std::size_t nextSizeClass(std::size_t c) noexcept
+{
+    if( c < 128 ) return c + min_block_alignment;
+    auto group = std::size_t{128};
+    while( group * 2 <= c ) group *= 2;
+    return c + group / 4;
+}
+
+// Smallest class able to hold size bytes whose natural alignment honours align.
+constexpr std::size_t sizeClassOf(std::size_t size, std::size_t align = min_block_alignment) noexcept
+{
+    align = std::max( align, min_block_alignment );
+    auto c = nextSizeClass( 0 );
+    while( c < size || c % align ) c = nextSizeClass( c );
+    return c;
+}
+
+constexpr std::size_t nextPowerOfTwo(std::size_t n) noexcept
+{
+    auto p = std::size_t{1};
+    while( p < n ) p *= 2;
+    return p;
+}
+
+struct PoolWatermarks
+{
+    std::size_t low  = 1;   // free slabs kept after reclaiming
+    std::size_t high = 0;   // free slabs which trigger reclaiming on put(), 0 to leave it to trim()
+};
+
+struct PoolStats
+{
+    std::size_t block_size;
+    std::size_t in_use;
+    std::size_t capacity;
+    std::size_t slabs;
+    std::size_t free_slabs;
+};
+
+// Slab allocator for fixed size blocks.
+//
+// Memory is taken from the pool arena in slabs which are carved into blocks
+// of RequestedSize bytes. Every slab threads a free list through its own free
+// blocks and the pool keeps its slabs in three lists (partially used, full
+// and free), so both get() and put() are O(1) and need no auxiliary
+// allocation. Slabs are aligned to their own size: put() finds the slab of a
+// block by masking its address. Free slabs are given back to the arena by
+// trim(), usually from a PoolReclaimer, or, for pools given a high watermark,
+// by put() as soon as the free slabs exceed it, at the cost of syscalls on
+// the path of the put().
+// Blocks keep the natural alignment of their size, which lets over-aligned
+// types share the pool of their size class. Define RECONDUIT_POOL_DEBUG to
+// check ownership and double frees on put().
 template<std::size_t RequestedSize>
 class ConduitsPool
 {
+    struct FreeBlock
+    {
+        FreeBlock* next_;
+    };
+
+    struct Slab
+    {
+        Slab*       next_;
+        Slab*       prev_;
+        FreeBlock*  free_;
+        std::size_t in_use_;
+    };
+
+    // Intrusive doubly linked list of slabs.
+    struct SlabList
+    {
+        Slab*       head_  = nullptr;
+        std::size_t count_ = 0;
+
+        void push(Slab* s) noexcept
+        {
+            s->prev_ = nullptr;
+            s->next_ = head_;
+            if( head_ ) head_->prev_ = s;
+            head_ = s;
+            ++count_;
+        }
+
+        void erase(Slab* s) noexcept
+        {
+            if( s->prev_ ) s->prev_->next_ = s->next_;
+            else           head_ = s->next_;
+            if( s->next_ ) s->next_->prev_ = s->prev_;
+            --count_;
+        }
+    };
+
+    static constexpr std::size_t min_blocks_per_slab_ = 16;
+
+    static constexpr std::size_t block_size_      = roundUp(std::max(RequestedSize, sizeof(FreeBlock)), min_block_alignment);
+    static constexpr std::size_t block_alignment_ = naturalAlignmentOf(block_size_);
+    static constexpr std::size_t header_size_     = roundUp(sizeof(Slab), block_alignment_);
+    static constexpr std::size_t slab_size_       = std::max(PoolArena::min_slab_size, nextPowerOfTwo(header_size_ + min_blocks_per_slab_ * block_size_));
+
+    static Slab* slabOf(const void* elem) noexcept
+    {
+        return reinterpret_cast<Slab*>( reinterpret_cast<std::uintptr_t>( elem ) & ~( slab_size_ - 1 ) );
+    }
+
 public:
 
-    constexpr ConduitsPool(std::size_t n = 0)
-        : in_used_{}
+    static constexpr std::size_t block_alignment = block_alignment_;
+    static constexpr std::size_t slab_size       = slab_size_;
+    static constexpr std::size_t blocks_per_slab = ( slab_size_ - header_size_ ) / block_size_;
+
+    constexpr ConduitsPool(std::size_t n = 0, PoolWatermarks w = {})
+        : partial_{}
+        , full_{}
         , free_{}
-        , pool_{}
+        , watermarks_{ w }
+        , in_use_{}
     {
-        SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
-        augmentPoolBy( n );
+        SPDLOG_DEBUG(getLogger(), "{}[{}] {} free slabs. in_use {} elements of size {}", __func__, static_cast<void*>(this), free_.count_, in_use_, RequestedSize);
+        reserve( n );
     }
 
     ~ConduitsPool()
     {
-        for( auto p : pool_ ) std::free( p );
-        SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
+        SPDLOG_DEBUG(getLogger(), "{}[{}] {} free slabs. in_use {} elements of size {}", __func__, static_cast<void*>(this), free_.count_, in_use_, RequestedSize);
+        for( auto list : { &partial_, &full_, &free_ } ) {
+            while( auto s = list->head_ ) {
+                list->erase( s );
+                getPoolArena().deallocate( s, slab_size_ );
+            }
+        }
     }
 
+    ConduitsPool(const ConduitsPool&)            = delete;
+    ConduitsPool& operator=(const ConduitsPool&) = delete;
+
     void* get()
     {
-        SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
-        if( free_.empty() ) augmentPoolBy();
-        auto [it, inserted] = in_used_.insert( free_.front() );
-        if( inserted ) {
-            SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
-            free_.pop_front();
-            return *it;
+        auto slab = partial_.head_;
+        if( ! slab ) {
+            if( ( slab = free_.head_ ) ) free_.erase( slab );
+            else slab = addSlab();
+            partial_.push( slab );
         }
-        throw std::bad_alloc();
+        auto block = slab->free_;
+        slab->free_ = block->next_;
+        ++slab->in_use_;
+        ++in_use_;
+        if( ! slab->free_ ) {
+            partial_.erase( slab );
+            full_.push( slab );
+        }
+        SPDLOG_DEBUG(getLogger(), "{}[{}] {} free slabs. in_use {} elements of size {}", __func__, static_cast<void*>(this), free_.count_, in_use_, RequestedSize);
+        return block;
     }
 
     void put(void* elem)
     {
         if( elem ) {
-            SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
-            free_.push_front( in_used_.extract( elem ).value() );
+#ifdef RECONDUIT_POOL_DEBUG
+            assert( owns( elem )     && "ConduitsPool::put() of a block not owned by this pool" );
+            assert( ! isFree( elem ) && "ConduitsPool::put() of a block which is already free" );
+#endif
+            auto slab  = slabOf( elem );
+            auto block = static_cast<FreeBlock*>( elem );
+            if( ! slab->free_ ) {
+                full_.erase( slab );
+                partial_.push( slab );
+            }
+            block->next_ = slab->free_;
+            slab->free_ = block;
+            --in_use_;
+            if( --slab->in_use_ == 0 ) {
+                partial_.erase( slab );
+                free_.push( slab );
+                if( watermarks_.high && free_.count_ > watermarks_.high ) trim( watermarks_.low );
+            }
+            SPDLOG_DEBUG(getLogger(), "{}[{}] {} free slabs. in_use {} elements of size {}", __func__, static_cast<void*>(this), free_.count_, in_use_, RequestedSize);
+        }
+    }
+
+    // Grows the pool until n more blocks can be handed out without touching
+    // the arena. Threading the free list writes every block, so the reserved
+    // memory is faulted in here and not on the traffic path.
+    void reserve(std::size_t n)
+    {
+        while( capacity() - in_use_ < n ) free_.push( addSlab() );
+    }
+
+    // Gives free slabs back to the arena, which returns their pages to the
+    // system, until no more than keep free slabs are left.
+    std::size_t trim(std::size_t keep = 0)
+    {
+        auto released = std::size_t{};
+        while( free_.count_ > keep ) {
+            auto s = free_.head_;
+            free_.erase( s );
+            getPoolArena().release( s, slab_size_ );
+            ++released;
         }
+        SPDLOG_DEBUG(getLogger(), "{}[{}] {} slabs released. in_use {} elements of size {}", __func__, static_cast<void*>(this), released, in_use_, RequestedSize);
+        return released;
     }
 
+    void setWatermarks(PoolWatermarks w) noexcept { watermarks_ = w; }
+    PoolWatermarks watermarks() const noexcept { return watermarks_; }
+
+    std::size_t inUse() const noexcept { return in_use_; }
+    std::size_t capacity() const noexcept { return slabs() * blocks_per_slab; }
+    std::size_t slabs() const noexcept { return partial_.count_ + full_.count_ + free_.count_; }
+    std::size_t freeSlabs() const noexcept { return free_.count_; }
+
+    PoolStats stats() const noexcept { return PoolStats{ block_size_, in_use_, capacity(), slabs(), free_.count_ }; }
+
 private:
 
-    auto augmentPoolBy(std::size_t n = 1)
+    Slab* addSlab()
     {
-        for( auto i = 0u; i < n; ++i ) free_.push_front( pool_.emplace_front( std::malloc( RequestedSize )) );
-        SPDLOG_DEBUG(getLogger(), "{}[{}] free is {}empty. in_use {} elements of size {}", __func__, static_cast<void*>(this), (free_.empty()?"":"NO "), in_used_.size(), RequestedSize);
+        auto raw  = static_cast<std::byte*>( getPoolArena().allocate( slab_size_ ) );
+        auto slab = new ( raw ) Slab{ nullptr, nullptr, nullptr, 0 };
+
+        // Thread blocks in reverse so that get() hands them out in address order.
+        auto blocks = raw + header_size_;
+        for( auto i = blocks_per_slab; i-- > 0; ) {
+            auto block = reinterpret_cast<FreeBlock*>( blocks + i * block_size_ );
+            block->next_ = slab->free_;
+            slab->free_ = block;
+        }
+        SPDLOG_DEBUG(getLogger(), "{}[{}] {} slabs. in_use {} elements of size {}", __func__, static_cast<void*>(this), slabs() + 1, in_use_, RequestedSize);
+        return slab;
     }
 
-    std::unordered_set<void*> in_used_;
-    std::forward_list<void*>  free_;
-    std::forward_list<void*>  pool_;
+#ifdef RECONDUIT_POOL_DEBUG
+    bool owns(const void* elem) const noexcept
+    {
+        auto slab = slabOf( elem );
+        for( auto list : { &partial_, &full_ } ) {
+            for( auto s = list->head_; s; s = s->next_ ) {
+                if( s == slab ) {
+                    auto offset = reinterpret_cast<std::uintptr_t>( elem ) - reinterpret_cast<std::uintptr_t>( s );
+                    return offset >= header_size_ && ( offset - header_size_ ) % block_size_ == 0 &&
+                           ( offset - header_size_ ) / block_size_ < blocks_per_slab;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool isFree(const void* elem) const noexcept
+    {
+        for( auto b = slabOf( elem )->free_; b; b = b->next_ ) if( b == elem ) return true;
+        return false;
+    }
+#endif
+
+    SlabList       partial_;
+    SlabList       full_;
+    SlabList       free_;
+    PoolWatermarks watermarks_;
+    std::size_t    in_use_;
 };
 
 template<std::size_t RequestedSize>
-inline ConduitsPool<RequestedSize>& getPoolInstance(std::size_t n = 0)
+using pool_depot_type = MagazineDepot<ConduitsPool<RequestedSize>>;
+
+// Every size class pool alive in the process, so that they can be reclaimed
+// and inspected as a whole.
+class PoolRegistry
 {
-    static ConduitsPool<RequestedSize> pool{ n };
+public:
+
+    struct Entry
+    {
+        std::size_t (*reclaim)();
+        PoolStats   (*stats)();
+    };
+
+    void add(Entry e)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        entries_.push_back( e );
+    }
+
+    std::size_t reclaim()
+    {
+        auto released = std::size_t{};
+        for( auto& e : entries() ) released += e.reclaim();
+        return released;
+    }
+
+    std::vector<PoolStats> stats()
+    {
+        std::vector<PoolStats> s;
+        for( auto& e : entries() ) s.push_back( e.stats() );
+        return s;
+    }
+
+private:
+
+    std::vector<Entry> entries()
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        return entries_;
+    }
+
+    std::mutex         mutex_;
+    std::vector<Entry> entries_;
+};
+
+inline PoolRegistry& getPoolRegistry()
+{
+    static auto registry = new PoolRegistry{};
+    return *registry;
+}
+
+template<std::size_t RequestedSize>
+inline pool_depot_type<RequestedSize>& getPoolInstance(std::size_t n = 0)
+{
+    static pool_depot_type<RequestedSize> pool{ n };
+    static bool registered = [] {
+        getPoolRegistry().add({
+            [] { return getPoolInstance<RequestedSize>().reclaim(); },
+            [] { return getPoolInstance<RequestedSize>().withSlab([](auto&& slab) { return slab.stats(); }); }
+        });
+        return true;
+    }();
+    (void)registered;
     return pool;
 }
 
+// Size class of T, and its pool, for per class tuning and inspection.
+template<typename T>
+inline auto& getPoolInstanceFor()
+{
+    return getPoolInstance<sizeClassOf(sizeof(T), alignof(T))>();
+}
+
+template<typename T>
+inline void setPoolWatermarks(PoolWatermarks w)
+{
+    getPoolInstanceFor<T>().withSlab([ w ](auto&& slab) { slab.setWatermarks( w ); });
+}
+
+inline std::size_t reclaimPools() { return getPoolRegistry().reclaim(); }
+inline std::vector<PoolStats> getPoolStats() { return getPoolRegistry().stats(); }
+
+// Background reclamation policy: every period, pools drain their depots and
+// give free slabs beyond their low watermark back to the system.
+class PoolReclaimer
+{
+public:
+
+    explicit PoolReclaimer(std::chrono::milliseconds period)
+        : period_{ period }
+        , stop_{}
+        , worker_{ [ this ] { run(); } }
+    {}
+
+    ~PoolReclaimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            stop_ = true;
+        }
+        wakeup_.notify_one();
+        worker_.join();
+    }
+
+    PoolReclaimer(const PoolReclaimer&)            = delete;
+    PoolReclaimer& operator=(const PoolReclaimer&) = delete;
+
+private:
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock{ mutex_ };
+        while( ! wakeup_.wait_for( lock, period_, [ this ] { return stop_; } ) ) {
+            lock.unlock();
+            [[maybe_unused]] auto released = reclaimPools();
+            SPDLOG_DEBUG(getLogger(), "{}[{}] {} slabs released", __func__, static_cast<void*>(this), released);
+            lock.lock();
+        }
+    }
+
+    std::chrono::milliseconds period_;
+    std::mutex                mutex_;
+    std::condition_variable   wakeup_;
+    bool                      stop_;
+    std::thread               worker_;
+};
+
+// Thread local magazines in front of the shared pool. The cache is reached
+// through a trivially destructible pointer so that blocks released after the
+// thread's cache is gone (e.g. during thread exit) fall back to the depot.
 template<std::size_t RequestedSize>
+inline MagazineCache<pool_depot_type<RequestedSize>>* getPoolCache()
+{
+    using cache_type = MagazineCache<pool_depot_type<RequestedSize>>;
+    struct CacheHolder
+    {
+        CacheHolder(cache_type*& p) : cache_{ getPoolInstance<RequestedSize>() }, cache_ptr_{ p } { cache_ptr_ = &cache_; }
+        ~CacheHolder() { cache_ptr_ = nullptr; }
+        cache_type   cache_;
+        cache_type*& cache_ptr_;
+    };
+    thread_local cache_type* cache_ptr = nullptr;
+    thread_local bool        created   = false;
+    if( ! created ) {
+        created = true;
+        thread_local CacheHolder holder{ cache_ptr };
+    }
+    return cache_ptr;
+}
+
+// Startup reservation: makes room for n more objects of type T in the pool of
+// its size class, e.g. reserveFor<Conduit, Protocol, TCPProtocol>( flows ).
+template<typename... T>
+inline void reserveFor(std::size_t n)
+{
+    ( getPoolInstanceFor<T>().withSlab([ n ](auto&& slab) { slab.reserve( n ); }), ... );
+}
+
+// Blocks are served by the pool of the size class of RequestedSize, so that
+// types of similar size share memory. Over-aligned types must pass their
+// alignment, both when getting and when putting back a block.
+template<std::size_t RequestedSize, std::size_t RequestedAlignment = min_block_alignment>
 inline void* getFromPool()
 {
-    auto value = getPoolInstance<RequestedSize>().get();
-    SPDLOG_DEBUG(getLogger(), "{}[{}] value of size {}", __func__, value, RequestedSize);
+    constexpr auto size_class = sizeClassOf(RequestedSize, RequestedAlignment);
+    static_assert(RequestedAlignment <= max_block_alignment, "Alignment not supported by conduit pools");
+
+    auto cache = getPoolCache<size_class>();
+    auto value = cache ? cache->get() : getPoolInstance<size_class>().get();
+    SPDLOG_DEBUG(getLogger(), "{}[{}] value of size {} (class {})", __func__, value, RequestedSize, size_class);
     return value;
 }
 
-template<std::size_t RequestedSize>
+template<std::size_t RequestedSize, std::size_t RequestedAlignment = min_block_alignment>
 inline void putToPool(void* value)
 {
-    SPDLOG_DEBUG(getLogger(), "{}[{}] value of size {}", __func__, value, RequestedSize);
-    return getPoolInstance<RequestedSize>().put( value );
+    constexpr auto size_class = sizeClassOf(RequestedSize, RequestedAlignment);
+
+    SPDLOG_DEBUG(getLogger(), "{}[{}] value of size {} (class {})", __func__, value, RequestedSize, size_class);
+    if( ! value ) return;
+    if( auto cache = getPoolCache<size_class>() ) cache->put( value );
+    else getPoolInstance<size_class>().put( value );
 }
 
 }
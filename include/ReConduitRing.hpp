@@ -0,0 +1,153 @@
+#ifndef __RECONDUIT_RING__HPP__
+#define __RECONDUIT_RING__HPP__
+
+#include "ReConduitMagazine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <type_traits>
+#include <cstddef>
+
+namespace reconduits {
+
+// Bounded lock-free rings of trivially copyable items (message envelopes,
+// pointers...). Capacity must be a power of two. Producer and consumer ends
+// live on their own cache lines.
+
+// One producer thread, one consumer thread.
+template<typename T, std::size_t Capacity>
+class SpscRing
+{
+    static_assert(( Capacity & ( Capacity - 1 ) ) == 0, "Ring capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Ring items are copied around as raw memory");
+
+    static constexpr std::size_t mask_ = Capacity - 1;
+
+public:
+
+    static constexpr std::size_t capacity = Capacity;
+
+    SpscRing() = default;
+    SpscRing(const SpscRing&)            = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    bool tryPush(const T& item) noexcept
+    {
+        auto tail = tail_.load( std::memory_order_relaxed );
+        if( tail - head_cache_ == Capacity ) {
+            head_cache_ = head_.load( std::memory_order_acquire );
+            if( tail - head_cache_ == Capacity ) return false;
+        }
+        items_[ tail & mask_ ] = item;
+        tail_.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Takes up to max items at once, returning how many.
+    std::size_t popBatch(T* out, std::size_t max) noexcept
+    {
+        auto head = head_.load( std::memory_order_relaxed );
+        if( tail_cache_ - head < max ) tail_cache_ = tail_.load( std::memory_order_acquire );
+        auto n = std::min( max, tail_cache_ - head );
+        for( auto i = std::size_t{}; i < n; ++i ) out[ i ] = items_[ ( head + i ) & mask_ ];
+        if( n ) head_.store( head + n, std::memory_order_release );
+        return n;
+    }
+
+    bool tryPop(T& item) noexcept { return popBatch( &item, 1 ) == 1; }
+
+    bool empty() const noexcept
+    {
+        return head_.load( std::memory_order_acquire ) == tail_.load( std::memory_order_acquire );
+    }
+
+private:
+
+    alignas(cache_line_size) std::atomic<std::size_t> head_{};
+    std::size_t tail_cache_{};
+    alignas(cache_line_size) std::atomic<std::size_t> tail_{};
+    std::size_t head_cache_{};
+    alignas(cache_line_size) std::array<T, Capacity> items_;
+};
+
+// Many producer threads, one consumer thread. Every cell carries a sequence
+// number telling whether it is ready to be written or read (D. Vyukov's
+// bounded queue), so producers only contend on the tail index.
+template<typename T, std::size_t Capacity>
+class MpscRing
+{
+    static_assert(( Capacity & ( Capacity - 1 ) ) == 0, "Ring capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Ring items are copied around as raw memory");
+
+    static constexpr std::size_t mask_ = Capacity - 1;
+
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence_;
+        T item_;
+    };
+
+public:
+
+    static constexpr std::size_t capacity = Capacity;
+
+    MpscRing()
+    {
+        for( auto i = std::size_t{}; i < Capacity; ++i ) cells_[ i ].sequence_.store( i, std::memory_order_relaxed );
+    }
+
+    MpscRing(const MpscRing&)            = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    bool tryPush(const T& item) noexcept
+    {
+        auto tail = tail_.load( std::memory_order_relaxed );
+        for(;;) {
+            auto& cell = cells_[ tail & mask_ ];
+            auto sequence = cell.sequence_.load( std::memory_order_acquire );
+            auto diff = static_cast<std::ptrdiff_t>( sequence ) - static_cast<std::ptrdiff_t>( tail );
+            if( diff == 0 ) {
+                if( tail_.compare_exchange_weak( tail, tail + 1, std::memory_order_relaxed ) ) {
+                    cell.item_ = item;
+                    cell.sequence_.store( tail + 1, std::memory_order_release );
+                    return true;
+                }
+            } else if( diff < 0 ) {
+                return false;
+            } else {
+                tail = tail_.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    std::size_t popBatch(T* out, std::size_t max) noexcept
+    {
+        auto n = std::size_t{};
+        while( n < max ) {
+            auto& cell = cells_[ head_ & mask_ ];
+            if( cell.sequence_.load( std::memory_order_acquire ) != head_ + 1 ) break;
+            out[ n++ ] = cell.item_;
+            cell.sequence_.store( head_ + Capacity, std::memory_order_release );
+            ++head_;
+        }
+        return n;
+    }
+
+    bool tryPop(T& item) noexcept { return popBatch( &item, 1 ) == 1; }
+
+    bool empty() const noexcept
+    {
+        return cells_[ head_ & mask_ ].sequence_.load( std::memory_order_acquire ) != head_ + 1;
+    }
+
+private:
+
+    alignas(cache_line_size) std::size_t head_{};
+    alignas(cache_line_size) std::atomic<std::size_t> tail_{};
+    alignas(cache_line_size) std::array<Cell, Capacity> cells_;
+};
+
+}
+
+#endif //__RECONDUIT_RING__HPP__
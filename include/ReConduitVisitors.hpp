@@ -2,7 +2,22 @@
 #define __RECONDUIT_VISITORS__HPP__
 
 #include <variant>
+#include <array>
+#include <utility>
 #include <type_traits>
+#include <cstddef>
+
+// Back-ends for the conduit x message double dispatch: nested std::visit, one
+// flat table of function pointers indexed by the pair of alternatives, or
+// switch statements over that same index. Which one is faster depends on the
+// compiler and the length of the type lists; see bench/dispatch_bench.cc.
+#define RECONDUIT_DISPATCH_VISIT  0
+#define RECONDUIT_DISPATCH_TABLE  1
+#define RECONDUIT_DISPATCH_SWITCH 2
+
+#ifndef RECONDUIT_DISPATCH_BACKEND
+#define RECONDUIT_DISPATCH_BACKEND RECONDUIT_DISPATCH_VISIT
+#endif
 
 namespace reconduits {
 
@@ -12,16 +27,6 @@ constexpr void dispatch(V v, auto&& f)
     std::visit([ &f ](auto&& conduit_ptr) { f( conduit_ptr ); }, v);
 }
 
-template<typename V, typename M>
-constexpr void doubleDispatch(V v, M m, auto&& f)
-{
-    std::visit([ & ](auto&& conduit_ptr) {
-        std::visit([ & ](auto&& message_ptr) {
-            f( conduit_ptr, message_ptr );
-        }, m);
-    }, v);
-}
-
 template<typename... U, typename V>
 constexpr void dispatchFor(V v, auto&& f)
 {
@@ -39,15 +44,101 @@ constexpr auto dispatch_r(V v, auto&& f)
 }
 
 template<typename V, typename M>
-constexpr auto doubleDispatch_r(V v, M m, auto&& f)
+constexpr auto visitDoubleDispatch_r(V v, M m, auto&& f)
 {
     return std::visit([ & ](auto&& conduit_ptr) {
-        return std::visit([ & ](auto&& message_ptr) {
-            return f( conduit_ptr, message_ptr );
+        return std::visit([ & ](auto&& message) {
+            return f( conduit_ptr, message );
         }, m);
     }, v);
 }
 
+namespace dispatch_detail {
+
+// Alternatives of V and M are numbered as v.index() * |M| + m.index().
+template<typename V, typename M>
+constexpr std::size_t pair_count = std::variant_size_v<V> * std::variant_size_v<M>;
+
+template<typename V, typename M>
+constexpr std::size_t pairIndex(const V& v, const M& m) noexcept
+{
+    return v.index() * std::variant_size_v<M> + m.index();
+}
+
+template<typename V, typename M, typename F>
+using result_t = decltype( std::declval<F&>()( *std::get_if<0>( std::declval<V*>() ), *std::get_if<0>( std::declval<M*>() ) ) );
+
+template<std::size_t I, typename R, typename V, typename M, typename F>
+constexpr R call(V& v, M& m, F& f)
+{
+    return f( *std::get_if<I / std::variant_size_v<M>>( &v ), *std::get_if<I % std::variant_size_v<M>>( &m ) );
+}
+
+template<typename R, typename V, typename M, typename F, std::size_t... I>
+constexpr auto makeTable(std::index_sequence<I...>) noexcept
+{
+    using call_type = R (*)(V&, M&, F&);
+    return std::array<call_type, sizeof...(I)>{ &call<I, R, V, M, F>... };
+}
+
+template<typename R, typename V, typename M, typename F>
+constexpr auto table = makeTable<R, V, M, F>( std::make_index_sequence<pair_count<V, M>>{} );
+
+// Sixteen cases per switch, chained for longer type lists.
+template<std::size_t Base, typename R, typename V, typename M, typename F>
+constexpr R switchCall(std::size_t index, V& v, M& m, F& f)
+{
+    constexpr auto count = pair_count<V, M>;
+    switch( index - Base ) {
+#define RECONDUIT_DISPATCH_CASE( N ) \
+        case N: if constexpr ( Base + N < count ) return call<Base + N, R>( v, m, f ); else break;
+        RECONDUIT_DISPATCH_CASE(  0 ) RECONDUIT_DISPATCH_CASE(  1 ) RECONDUIT_DISPATCH_CASE(  2 ) RECONDUIT_DISPATCH_CASE(  3 )
+        RECONDUIT_DISPATCH_CASE(  4 ) RECONDUIT_DISPATCH_CASE(  5 ) RECONDUIT_DISPATCH_CASE(  6 ) RECONDUIT_DISPATCH_CASE(  7 )
+        RECONDUIT_DISPATCH_CASE(  8 ) RECONDUIT_DISPATCH_CASE(  9 ) RECONDUIT_DISPATCH_CASE( 10 ) RECONDUIT_DISPATCH_CASE( 11 )
+        RECONDUIT_DISPATCH_CASE( 12 ) RECONDUIT_DISPATCH_CASE( 13 ) RECONDUIT_DISPATCH_CASE( 14 ) RECONDUIT_DISPATCH_CASE( 15 )
+#undef RECONDUIT_DISPATCH_CASE
+        default: break;
+    }
+    if constexpr ( Base + 16 < count ) return switchCall<Base + 16, R>( index, v, m, f );
+    else __builtin_unreachable();
+}
+
+}
+
+template<typename V, typename M>
+constexpr auto tableDoubleDispatch_r(V v, M m, auto&& f)
+{
+    using F = std::remove_reference_t<decltype(f)>;
+    using R = dispatch_detail::result_t<V, M, F>;
+    return dispatch_detail::table<R, V, M, F>[ dispatch_detail::pairIndex( v, m ) ]( v, m, f );
+}
+
+template<typename V, typename M>
+constexpr auto switchDoubleDispatch_r(V v, M m, auto&& f)
+{
+    using F = std::remove_reference_t<decltype(f)>;
+    using R = dispatch_detail::result_t<V, M, F>;
+    return dispatch_detail::switchCall<0, R>( dispatch_detail::pairIndex( v, m ), v, m, f );
+}
+
+template<typename V, typename M>
+constexpr auto doubleDispatch_r(V v, M m, auto&& f)
+{
+#if RECONDUIT_DISPATCH_BACKEND == RECONDUIT_DISPATCH_TABLE
+    return tableDoubleDispatch_r(v, m, f);
+#elif RECONDUIT_DISPATCH_BACKEND == RECONDUIT_DISPATCH_SWITCH
+    return switchDoubleDispatch_r(v, m, f);
+#else
+    return visitDoubleDispatch_r(v, m, f);
+#endif
+}
+
+template<typename V, typename M>
+constexpr void doubleDispatch(V v, M m, auto&& f)
+{
+    doubleDispatch_r(v, m, [ &f ](auto&& conduit_ptr, auto&& message) { f( conduit_ptr, message ); });
+}
+
 template<typename R, typename... U, typename V>
 constexpr auto dispatchFor_r(V v, auto&& f)
 {
@@ -20,21 +20,6 @@ public:
 
     auto getOrigin() const { return conduit_origin_; }
 
-    static void* operator new(std::size_t sz)
-    {
-        return getFromPool<sizeof(Release)>();
-    }
-
-    static void* operator new(std::size_t sz, Release* p)
-    {
-        return ::operator new(sz, p);
-    }
-
-    static void operator delete(void* p)
-    {
-        putToPool<sizeof(Release)>( p );
-    }
-
 private:
 
     Conduit* conduit_origin_;
@@ -0,0 +1,160 @@
+#ifndef __ROUTE_CACHE_RECONDUIT__HPP__
+#define __ROUTE_CACHE_RECONDUIT__HPP__
+
+#include <memory_resource>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+// Entries the route cache of every opted in Mux starts with, and the most it
+// grows to (powers of two).
+#ifndef RECONDUIT_ROUTE_CACHE_SIZE
+#define RECONDUIT_ROUTE_CACHE_SIZE 256
+#endif
+
+#ifndef RECONDUIT_ROUTE_CACHE_MAX_SIZE
+#define RECONDUIT_ROUTE_CACHE_MAX_SIZE ( 1 << 20 )
+#endif
+
+namespace reconduits {
+
+class Conduit;
+
+// Hash of the flow keys given by muxes. Tuples, as used for 5-tuples, are
+// combined element by element.
+template<typename Key>
+struct FlowHash : std::hash<Key> {};
+
+template<typename... T>
+struct FlowHash<std::tuple<T...>>
+{
+    std::size_t operator()(const std::tuple<T...>& key) const noexcept
+    {
+        return hash( key, std::index_sequence_for<T...>{} );
+    }
+
+private:
+
+    template<std::size_t... I>
+    static std::size_t hash(const std::tuple<T...>& key, std::index_sequence<I...>) noexcept
+    {
+        std::size_t h{};
+        ( ( h = ( h ^ FlowHash<std::decay_t<T>>{}( std::get<I>( key ) ) ) * 0x9e3779b97f4a7c15ull ), ... );
+        return h ^ ( h >> 29 );
+    }
+};
+
+// Final avalanche of MurmurHash3, so that every bit of the key counts in the
+// low bits tables and caches index with (and in the high bits FlatFlowTable
+// keeps in its control bytes).
+constexpr std::uint64_t mixFlowHash(std::uint64_t h) noexcept
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ ( h >> 33 );
+}
+
+// Muxes opt in to route caching by telling the flow a message belongs to:
+//
+//     auto flowKey(auto&& msg) const { return msg.get().getFlowId(); }
+//
+// Keys must be equality comparable and hashable by FlowHash.
+template<typename U, typename M, typename = void>
+struct has_flow_key : std::false_type {};
+
+template<typename U, typename M>
+struct has_flow_key<U, M, std::void_t<decltype( std::declval<const U&>().flowKey( std::declval<M&>() ) )>> : std::true_type {};
+
+// Direct mapped cache of the side B conduit serving every flow. Entries are
+// dropped one by one, as their flows get new routes or go away. The cache
+// doubles whenever three quarters of its entries are in use, which keeps it
+// about as large as the number of flows of its mux, up to
+// RECONDUIT_ROUTE_CACHE_MAX_SIZE entries.
+template<typename Key, typename Hash = FlowHash<Key>>
+class RouteCache
+{
+    static constexpr std::size_t min_size_ = RECONDUIT_ROUTE_CACHE_SIZE;
+    static constexpr std::size_t max_size_ = RECONDUIT_ROUTE_CACHE_MAX_SIZE;
+    static_assert(( min_size_ & ( min_size_ - 1 ) ) == 0, "RECONDUIT_ROUTE_CACHE_SIZE must be a power of two");
+    static_assert(( max_size_ & ( max_size_ - 1 ) ) == 0, "RECONDUIT_ROUTE_CACHE_MAX_SIZE must be a power of two");
+
+    struct Entry
+    {
+        Key      key_;
+        Conduit* next_;
+    };
+
+public:
+
+    using key_type = Key;
+
+    explicit RouteCache(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : entries_( min_size_, resource )
+        , used_{}
+    {}
+
+    Conduit* find(const Key& key) const noexcept
+    {
+        auto& e = entryOf( key );
+        return e.next_ && e.key_ == key ? e.next_ : nullptr;
+    }
+
+    void insert(const Key& key, Conduit* next)
+    {
+        if( ! next ) return erase( key );
+        if( used_ >= entries_.size() / 4 * 3 && entries_.size() < max_size_ ) grow();
+        auto& e = entryOf( key );
+        if( ! e.next_ ) ++used_;
+        e = Entry{ key, next };
+    }
+
+    void erase(const Key& key) noexcept
+    {
+        auto& e = entryOf( key );
+        if( e.next_ && e.key_ == key ) {
+            e.next_ = nullptr;
+            --used_;
+        }
+    }
+
+    void clear() noexcept
+    {
+        for( auto& e : entries_ ) e.next_ = nullptr;
+        used_ = 0;
+    }
+
+    std::size_t size() const noexcept { return used_; }
+    std::size_t capacity() const noexcept { return entries_.size(); }
+
+private:
+
+    // Entries colliding in the larger cache are dropped.
+    void grow()
+    {
+        auto old = std::move( entries_ );
+        entries_ = std::pmr::vector<Entry>( old.size() * 2, old.get_allocator() );
+        used_ = 0;
+        for( auto& e : old ) {
+            if( ! e.next_ ) continue;
+            auto& slot = entryOf( e.key_ );
+            if( ! slot.next_ ) ++used_;
+            slot = e;
+        }
+    }
+
+    Entry& entryOf(const Key& key) noexcept { return entries_[ mixFlowHash( Hash{}( key ) ) & ( entries_.size() - 1 ) ]; }
+    const Entry& entryOf(const Key& key) const noexcept { return entries_[ mixFlowHash( Hash{}( key ) ) & ( entries_.size() - 1 ) ]; }
+
+    std::pmr::vector<Entry> entries_;
+    std::size_t             used_;
+};
+
+}
+
+#endif  // __ROUTE_CACHE_RECONDUIT__HPP__
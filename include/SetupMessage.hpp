@@ -22,21 +22,6 @@ public:
 
     auto getOrigin() const { return conduit_origin_; }
 
-    static void* operator new(std::size_t sz)
-    {
-        return getFromPool<sizeof(Setup)>();
-    }
-
-    static void* operator new(std::size_t sz, Setup* p)
-    {
-        return ::operator new(sz, p);
-    }
-
-    static void operator delete(void* p)
-    {
-        putToPool<sizeof(Setup)>( p );
-    }
-
 private:
 
     Conduit* conduit_origin_;
@@ -0,0 +1,92 @@
+#ifndef __SHARDED_RUNTIME_RECONDUIT__HPP__
+#define __SHARDED_RUNTIME_RECONDUIT__HPP__
+
+#include "AsyncBoundary.hpp"
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+namespace reconduits {
+
+// Runs one replica of a conduit graph per worker thread, RSS style: every
+// message is steered to a shard by its flow hash, so a flow always meets the
+// same replica and replicas share no state (mux tables, Lua states...).
+//
+// Graph is whatever the builder makes for a shard; it must give the conduit
+// where messages come in through entry(). Replicas are built by the thread
+// constructing the runtime and driven by their worker only afterwards.
+//
+//     auto runtime = makeShardedRuntime<Message>(std::thread::hardware_concurrency(),
+//             [](std::size_t shard) { return std::make_unique<DPIGraph>(); },
+//             [](const Message& m) { return FlowHash<key_type>{}( m.getFlowId() ); });
+//     runtime->accept( InformationChunk<Message>{ msg } );
+template<typename T, typename Graph, typename Steer, typename Channel = MpscChannel<T>>
+class ShardedRuntime
+{
+    // Channels go first, so that they are drained before graphs go away.
+    struct Shard
+    {
+        std::unique_ptr<Graph>   graph_;
+        std::unique_ptr<Channel> channel_;
+    };
+
+public:
+
+    template<typename Builder>
+    ShardedRuntime(std::size_t shards, Builder&& build, Steer steer)
+        : steer_{ std::move( steer ) }
+    {
+        shards_.reserve( shards );
+        for( auto i = std::size_t{}; i < shards; ++i ) {
+            std::unique_ptr<Graph> graph{ build( i ) };
+            auto& entry = graph->entry();
+            shards_.push_back( Shard{ std::move( graph ), std::make_unique<Channel>( entry ) } );
+        }
+    }
+
+    ShardedRuntime(const ShardedRuntime&)            = delete;
+    ShardedRuntime& operator=(const ShardedRuntime&) = delete;
+
+    std::size_t size() const noexcept { return shards_.size(); }
+
+    std::size_t shardOf(const T& msg) const { return steer_( msg ) % shards_.size(); }
+
+    // The payload is copied, so msg may go away as soon as this returns.
+    void accept(auto&& msg)
+    {
+        if constexpr ( is_batch_v<decltype(msg)> ) {
+            for( auto m : msg ) shards_[ shardOf( *m ) ].channel_->push( InformationChunk<T>{ *m } );
+        } else {
+            shards_[ shardOf( msg.get() ) ].channel_->push( msg );
+        }
+    }
+
+    // Waits until every message accepted so far has been processed.
+    void flush() const
+    {
+        for( auto& shard : shards_ ) shard.channel_->flush();
+    }
+
+    Graph& graph(std::size_t shard) noexcept { return *shards_[ shard ].graph_; }
+    std::size_t delivered(std::size_t shard) const noexcept { return shards_[ shard ].channel_->delivered(); }
+
+private:
+
+    Steer steer_;
+    std::vector<Shard> shards_;
+};
+
+template<typename T, typename Builder, typename Steer>
+auto makeShardedRuntime(std::size_t shards, Builder&& build, Steer&& steer)
+{
+    using graph_type = typename std::decay_t<decltype( build( std::size_t{} ) )>::element_type;
+    using runtime_type = ShardedRuntime<T, graph_type, std::decay_t<Steer>>;
+    return std::make_unique<runtime_type>( shards, std::forward<Builder>( build ), std::forward<Steer>( steer ) );
+}
+
+}
+
+#endif  // __SHARDED_RUNTIME_RECONDUIT__HPP__
@@ -0,0 +1,69 @@
+#ifndef __STATIC_CHAIN_RECONDUIT__HPP__
+#define __STATIC_CHAIN_RECONDUIT__HPP__
+
+#include "ReConduitFwd.hpp"
+
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <cstddef>
+
+namespace reconduits {
+
+// User protocol made of protocols which are always connected side B to side A
+// in the same order, e.g.
+//
+//     Conduit parser{ Protocol{ StaticChain<EthernetProtocol, IPv4Protocol, TCPProtocol>{} } };
+//
+// The chain is one Conduit for the rest of the graph, while a message going
+// through it costs direct (and inlinable) calls from one stage to the next
+// instead of a Conduit per stage with its dispatch over every variant.
+//
+// A stage handing a message on to NextSide::b feeds the next stage. Anything
+// else leaves the chain as the answer of the chain itself, so stages meant to
+// talk back to side A must be first in the chain. Every stage sees the Conduit
+// holding the chain as its context conduit.
+template<typename... Stages>
+class StaticChain
+{
+    static_assert(sizeof...(Stages) > 0, "StaticChain needs one stage at least");
+
+public:
+
+    constexpr StaticChain() = default;
+    constexpr explicit StaticChain(Stages... stages) : stages_{ std::move( stages )... } {}
+
+    static constexpr std::size_t size() noexcept { return sizeof...(Stages); }
+
+    template<std::size_t I>
+    constexpr auto& stage() noexcept { return std::get<I>( stages_ ); }
+
+    constexpr auto accept(auto&& msg, Conduit* ctx_conduit)
+    {
+        return acceptFrom<0>(msg, ctx_conduit);
+    }
+
+private:
+
+    template<std::size_t I>
+    constexpr auto acceptFrom(auto&& msg, Conduit* ctx_conduit)
+    {
+        auto [ next, next_v_msg ] = std::get<I>( stages_ ).accept(msg, ctx_conduit);
+        if constexpr ( I + 1 == sizeof...(Stages) ) {
+            return std::pair{ next, next_v_msg };
+        } else {
+            if( next != NextSide::b ) return std::pair{ next, next_v_msg };
+            // Stages mostly pass on the kind of message they get, which needs no visit.
+            using message_kind = std::decay_t<decltype(msg)>;
+            if( auto same_kind = std::get_if<message_kind>( &next_v_msg ) ) return acceptFrom<I + 1>(*same_kind, ctx_conduit);
+            auto accept_next = [ & ](auto&& message) { return acceptFrom<I + 1>(message, ctx_conduit); };
+            return std::visit(accept_next, next_v_msg);
+        }
+    }
+
+    std::tuple<Stages...> stages_;
+};
+
+}
+
+#endif  // __STATIC_CHAIN_RECONDUIT__HPP__
@@ -0,0 +1,419 @@
+#ifndef __WORK_STEALING_RECONDUIT__HPP__
+#define __WORK_STEALING_RECONDUIT__HPP__
+
+#include "AsyncBoundary.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace reconduits {
+
+// Unit of work of the executor, linked into strands, or into the overflow of
+// a worker, through next_.
+struct WorkTask
+{
+    void (*run_)(WorkTask*);
+    std::atomic<WorkTask*> next_{};
+};
+
+// Chase-Lev deque: its owner pushes and pops at the bottom while thieves take
+// from the top, only racing the owner for the last item (after Lê et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models"). Bounded, so
+// push tells whether there was room.
+template<typename T, std::size_t Capacity>
+class ChaseLevDeque
+{
+    static_assert(( Capacity & ( Capacity - 1 ) ) == 0, "Deque capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Deque items are copied around as raw memory");
+
+    static constexpr std::int64_t mask_ = Capacity - 1;
+
+public:
+
+    ChaseLevDeque() = default;
+    ChaseLevDeque(const ChaseLevDeque&)            = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    bool push(T item) noexcept
+    {
+        auto b = bottom_.load( std::memory_order_relaxed );
+        if( b - top_.load( std::memory_order_acquire ) >= static_cast<std::int64_t>( Capacity ) ) return false;
+        items_[ b & mask_ ].store( item, std::memory_order_relaxed );
+        bottom_.store( b + 1, std::memory_order_release );
+        return true;
+    }
+
+    bool pop(T& item) noexcept
+    {
+        auto b = bottom_.load( std::memory_order_relaxed ) - 1;
+        bottom_.store( b, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        auto t = top_.load( std::memory_order_relaxed );
+        auto taken = t <= b;
+        if( taken ) {
+            item = items_[ b & mask_ ].load( std::memory_order_relaxed );
+            if( t == b ) taken = top_.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+        }
+        if( ! taken || t == b ) bottom_.store( b + 1, std::memory_order_relaxed );
+        return taken;
+    }
+
+    bool steal(T& item) noexcept
+    {
+        auto t = top_.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        auto b = bottom_.load( std::memory_order_acquire );
+        if( t >= b ) return false;
+        item = items_[ t & mask_ ].load( std::memory_order_relaxed );
+        return top_.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+    }
+
+private:
+
+    alignas(cache_line_size) std::atomic<std::int64_t> top_{};
+    alignas(cache_line_size) std::atomic<std::int64_t> bottom_{};
+    alignas(cache_line_size) std::array<std::atomic<T>, Capacity> items_{};
+};
+
+// Pool of workers running tasks, each from a deque of its own. Tasks
+// scheduled by a worker go to its deque, the others to a shared injection
+// ring which idle workers drain. A worker out of tasks steals from the top
+// of the deques of the others, so a long running task only holds its own
+// worker. A worker with both its deque and the ring full keeps the task in
+// an overflow list of its own, never running it in place: a strand
+// rescheduling itself would otherwise recurse. Queued tasks are run before
+// the executor goes away.
+class WorkStealingExecutor
+{
+    static constexpr std::size_t deque_size_     = 4096;
+    static constexpr std::size_t injection_size_ = 4096;
+    static constexpr std::size_t injection_take_ = 32;
+
+    struct Worker
+    {
+        WorkStealingExecutor* executor_;
+        std::size_t index_;
+        ChaseLevDeque<WorkTask*, deque_size_> deque_;
+        WorkTask* overflow_{};
+        std::thread thread_;
+    };
+
+public:
+
+    explicit WorkStealingExecutor(std::size_t workers = std::max( 1u, std::thread::hardware_concurrency() ))
+        : queued_{}
+        , sleeping_{}
+        , stop_{}
+    {
+        workers_.reserve( workers );
+        for( auto i = std::size_t{}; i < workers; ++i ) workers_.push_back( std::make_unique<Worker>() );
+        for( auto i = std::size_t{}; i < workers; ++i ) {
+            auto& worker = *workers_[ i ];
+            worker.executor_ = this;
+            worker.index_ = i;
+            worker.thread_ = std::thread{ [ this, &worker ]{ run( worker ); } };
+        }
+    }
+
+    ~WorkStealingExecutor()
+    {
+        stop_.store( true, std::memory_order_release );
+        wake( true );
+        for( auto& worker : workers_ ) worker->thread_.join();
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor&)            = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    std::size_t size() const noexcept { return workers_.size(); }
+
+    void schedule(WorkTask* task)
+    {
+        auto worker = current();
+        queued_.fetch_add( 1, std::memory_order_relaxed );
+        if( worker && worker->executor_ == this ) {
+            if( ! worker->deque_.push( task ) && ! injection_.tryPush( task ) ) overflow( *worker, task );
+        } else {
+            while( ! injection_.tryPush( task ) ) std::this_thread::yield();
+        }
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( sleeping_.load( std::memory_order_relaxed ) ) wake( false );
+    }
+
+private:
+
+    static Worker*& current() noexcept
+    {
+        thread_local Worker* worker{};
+        return worker;
+    }
+
+    void run(Worker& worker)
+    {
+        current() = &worker;
+        for(;;) {
+            if( auto task = next( worker ) ) {
+                queued_.fetch_sub( 1, std::memory_order_relaxed );
+                task->run_( task );
+            } else if( stop_.load( std::memory_order_acquire ) ) {
+                if( queued_.load( std::memory_order_acquire ) == 0 ) return;
+                std::this_thread::yield();
+            } else {
+                sleep();
+            }
+        }
+    }
+
+    WorkTask* next(Worker& worker)
+    {
+        WorkTask* task{};
+        if( worker.deque_.pop( task ) ) return task;
+
+        // The overflow goes back to the deque, where the others can steal it.
+        if( ( task = worker.overflow_ ) ) {
+            worker.overflow_ = task->next_.load( std::memory_order_relaxed );
+            while( worker.overflow_ && worker.deque_.push( worker.overflow_ ) ) {
+                worker.overflow_ = worker.overflow_->next_.load( std::memory_order_relaxed );
+            }
+            return task;
+        }
+
+        // One worker at a time takes its share of the injection ring.
+        if( ! injection_busy_.test_and_set( std::memory_order_acquire ) ) {
+            WorkTask* taken[ injection_take_ ];
+            auto n = injection_.popBatch( taken, injection_take_ );
+            injection_busy_.clear( std::memory_order_release );
+            if( n ) {
+                for( auto i = std::size_t{ 1 }; i < n; ++i ) {
+                    if( ! worker.deque_.push( taken[ i ] ) ) overflow( worker, taken[ i ] );
+                }
+                return taken[ 0 ];
+            }
+        }
+
+        for( auto i = std::size_t{ 1 }; i < workers_.size(); ++i ) {
+            auto& victim = *workers_[ ( worker.index_ + i ) % workers_.size() ];
+            if( victim.deque_.steal( task ) ) return task;
+        }
+        return nullptr;
+    }
+
+    // Only touched by the worker itself, and still counted in queued_.
+    static void overflow(Worker& worker, WorkTask* task) noexcept
+    {
+        task->next_.store( worker.overflow_, std::memory_order_relaxed );
+        worker.overflow_ = task;
+    }
+
+    // Same handshake as AsyncChannel: schedule looks at sleeping_ after
+    // queuing, and workers at queued_ after raising sleeping_.
+    void sleep()
+    {
+        std::unique_lock<std::mutex> lock{ mutex_ };
+        sleeping_.fetch_add( 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( queued_.load( std::memory_order_relaxed ) == 0 && ! stop_.load( std::memory_order_acquire ) ) {
+            wakeup_.wait( lock );
+        }
+        sleeping_.fetch_sub( 1, std::memory_order_relaxed );
+    }
+
+    void wake(bool all)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        if( all ) wakeup_.notify_all();
+        else      wakeup_.notify_one();
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MpscRing<WorkTask*, injection_size_> injection_;
+    std::atomic_flag injection_busy_ = ATOMIC_FLAG_INIT;
+    alignas(cache_line_size) std::atomic<std::size_t> queued_;
+    alignas(cache_line_size) std::atomic<std::size_t> sleeping_;
+    std::atomic<bool> stop_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+};
+
+// Tasks run one at a time and in the order they were posted, whichever
+// worker runs them. The strand is itself the task scheduled on the executor
+// while it has work, giving its worker back every budget_ tasks so that an
+// elephant flow does not starve the others. Posted tasks are queued in an
+// intrusive MPSC list (D. Vyukov's), with stub_ standing for an empty one.
+class Strand : public WorkTask
+{
+    static constexpr std::size_t budget_ = 64;
+
+public:
+
+    Strand() noexcept
+        : WorkTask{ &Strand::runTasks }
+        , head_{ &stub_ }
+        , tail_{ &stub_ }
+        , count_{}
+    {}
+
+    Strand(const Strand&)            = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    void bind(WorkStealingExecutor& executor) noexcept { executor_ = &executor; }
+
+    void post(WorkTask* task)
+    {
+        enqueue( task );
+        if( count_.fetch_add( 1, std::memory_order_acq_rel ) == 0 ) executor_->schedule( this );
+    }
+
+    bool idle() const noexcept { return count_.load( std::memory_order_acquire ) == 0; }
+
+private:
+
+    static void runTasks(WorkTask* task)
+    {
+        auto& strand = *static_cast<Strand*>( task );
+        for( auto done = std::size_t{}; ; ) {
+            auto next = strand.dequeue();
+            next->run_( next );
+            if( strand.count_.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) return;
+            if( ++done == budget_ ) return strand.executor_->schedule( &strand );
+        }
+    }
+
+    void enqueue(WorkTask* task) noexcept
+    {
+        task->next_.store( nullptr, std::memory_order_relaxed );
+        head_.exchange( task, std::memory_order_acq_rel )->next_.store( task, std::memory_order_release );
+    }
+
+    // Only called knowing a task was posted, which may still be linking in.
+    WorkTask* dequeue() noexcept
+    {
+        for(;;) {
+            auto tail = tail_;
+            auto next = tail->next_.load( std::memory_order_acquire );
+            if( tail == &stub_ ) {
+                if( next ) { tail_ = next; continue; }
+            } else if( next ) {
+                tail_ = next;
+                return tail;
+            } else if( tail == head_.load( std::memory_order_acquire ) ) {
+                enqueue( &stub_ );
+                continue;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    WorkTask stub_{};
+    alignas(cache_line_size) std::atomic<WorkTask*> head_;
+    alignas(cache_line_size) WorkTask* tail_;
+    WorkStealingExecutor* executor_{};
+    std::atomic<std::size_t> count_;
+};
+
+// Channel for an AsyncBoundary running the downstream conduit as tasks of a
+// work stealing executor. Messages are mapped to one of Strands strands by
+// the flow hash given by Steer, so that flows are kept in order while
+// different flows run on any worker at once. Conduits behind are then called
+// from several threads, one flow at a time, and must keep their state per
+// flow (e.g. protocols built per flow by a factory):
+//
+//     WorkStealingExecutor executor;
+//     FlowStrands<Message, FlowOfMessage> strands{ executor, l7_conduit };
+//     Conduit boundary{ Protocol{ AsyncBoundary<FlowStrands<Message, FlowOfMessage>>{ strands } } };
+template<typename T, typename Steer, std::size_t Strands = 256>
+class FlowStrands
+{
+    static_assert(( Strands & ( Strands - 1 ) ) == 0, "Strands must be a power of two");
+
+    using Kind = typename AsyncEnvelope<T>::Kind;
+
+    // Copy of the message, taken from the pools like across an AsyncChannel,
+    // and like there without the origin of control messages.
+    struct Delivery : WorkTask
+    {
+        FlowStrands* strands_;
+        T            payload_;
+        Kind         kind_;
+    };
+
+public:
+
+    explicit FlowStrands(WorkStealingExecutor& executor, Conduit& downstream, Steer steer = {})
+        : downstream_{ &downstream }
+        , steer_{ std::move( steer ) }
+        , pushed_{}
+        , delivered_{}
+    {
+        for( auto& strand : strands_ ) strand.bind( executor );
+    }
+
+    ~FlowStrands()
+    {
+        flush();
+        for( auto& strand : strands_ ) while( ! strand.idle() ) std::this_thread::yield();
+    }
+
+    FlowStrands(const FlowStrands&)            = delete;
+    FlowStrands& operator=(const FlowStrands&) = delete;
+
+    void push(auto&& msg)
+    {
+        using M = std::decay_t<decltype(msg)>;
+        auto kind = Kind::information_chunk;
+        if constexpr ( std::is_same_v<M, Setup<T>> )    kind = Kind::setup;
+        if constexpr ( std::is_same_v<M, Release<T>> )  kind = Kind::release;
+        if constexpr ( std::is_same_v<M, Alerting<T>> ) kind = Kind::alerting;
+
+        auto delivery = new ( getFromPool<sizeof(Delivery), alignof(Delivery)>() ) Delivery{ { &FlowStrands::deliver }, this, msg.get(), kind };
+        pushed_.fetch_add( 1, std::memory_order_relaxed );
+        strands_[ steer_( msg.get() ) & ( Strands - 1 ) ].post( delivery );
+    }
+
+    // Waits until everything pushed so far has been delivered.
+    void flush() const
+    {
+        auto pushed = pushed_.load( std::memory_order_relaxed );
+        while( delivered_.load( std::memory_order_acquire ) < pushed ) std::this_thread::yield();
+    }
+
+    std::size_t delivered() const noexcept { return delivered_.load( std::memory_order_acquire ); }
+
+private:
+
+    static void deliver(WorkTask* task)
+    {
+        auto delivery = static_cast<Delivery*>( task );
+        auto& strands = *delivery->strands_;
+        auto& payload = delivery->payload_;
+        switch( delivery->kind_ ) {
+            case Kind::information_chunk: send( strands.downstream_, InformationChunk<T>{ payload } ); break;
+            case Kind::setup:    send( strands.downstream_, Setup<T>{ payload, nullptr } ); break;
+            case Kind::release:  send( strands.downstream_, Release<T>{ payload, nullptr } ); break;
+            case Kind::alerting: send( strands.downstream_, Alerting<T>{ payload, nullptr } ); break;
+        }
+        delivery->~Delivery();
+        putToPool<sizeof(Delivery), alignof(Delivery)>( delivery );
+        strands.delivered_.fetch_add( 1, std::memory_order_release );
+    }
+
+    Conduit* downstream_;
+    Steer steer_;
+    std::array<Strand, Strands> strands_;
+    alignas(cache_line_size) std::atomic<std::size_t> pushed_;
+    alignas(cache_line_size) std::atomic<std::size_t> delivered_;
+};
+
+}
+
+#endif  // __WORK_STEALING_RECONDUIT__HPP__
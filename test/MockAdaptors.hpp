@@ -10,6 +10,8 @@
 #include <type_traits>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <mutex>
 
 namespace mock_conduits {
 
@@ -25,6 +27,34 @@ struct NetworkAdapter
         emsg.append( "NetworkAdapter" );
         return std::pair{ reconduits::NextSide::a, make_variant_message( msg ) };
     }
+    constexpr auto acceptBatch(auto&& batch)
+    {
+        for( auto m : batch ) m->append( "NetworkAdapter" );
+        return std::pair{ reconduits::NextSide::a, batch };
+    }
+};
+
+// Keeps the trace of every message it gets, and the origin of every control
+// message if asked to.
+struct RecorderAdapter
+{
+    constexpr auto accept(auto&& msg)
+    {
+        using T = std::decay_t<decltype(msg)>;
+        std::ostringstream trace;
+        trace << msg.get();
+        std::unique_lock<std::mutex> lock;
+        if( mutex_ ) lock = std::unique_lock<std::mutex>{ *mutex_ };
+        traces_->push_back( trace.str() );
+        if constexpr ( ! std::is_same_v<T, reconduits::InformationChunk<Message>> ) {
+            if( origins_ ) origins_->push_back( msg.getOrigin() );
+        }
+        return std::pair{ reconduits::NextSide::done, make_variant_message( msg ) };
+    }
+
+    std::vector<std::string>* traces_;
+    std::mutex* mutex_{};
+    std::vector<reconduits::Conduit*>* origins_{};
 };
 
 struct EndPointAdapter
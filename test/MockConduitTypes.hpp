@@ -5,18 +5,34 @@
 #include "MockProtocols.hpp"
 #include "MockFactories.hpp"
 #include "ReConduitTypesGenerators.hpp"
+#include "StaticChain.hpp"
+#include "AsyncBoundary.hpp"
+#include "WorkStealing.hpp"
+#include "CreditGate.hpp"
+
+#ifdef __cpp_impl_coroutine
+#define MOCK_COROUTINE_PROTOCOLS , reconduits::CoroutineProtocol<mock_conduits::TLSHelloParser>
+#else
+#define MOCK_COROUTINE_PROTOCOLS
+#endif
 
 //////////////////////////////////////
 // Conduit Types
 //////////////////////////////////////
 
-GENERATE_ADAPTER_CONDUITS(  mock_conduits::NetworkAdapter, mock_conduits::EndPointAdapter );
+GENERATE_ADAPTER_CONDUITS(  mock_conduits::NetworkAdapter, mock_conduits::EndPointAdapter, mock_conduits::RecorderAdapter );
 GENERATE_FACTORY_CONDUITS(  mock_conduits::NetworkFactory, \
                              mock_conduits::TCPConnectionFactory, mock_conduits::UDPConnectionFactory );
-GENERATE_MUX_CONDUITS(      mock_conduits::L3Mux, mock_conduits::L4Mux, mock_conduits::L4LUAMux );
+GENERATE_MUX_CONDUITS(      mock_conduits::L3Mux, mock_conduits::L4Mux, mock_conduits::L4LUAMux, mock_conduits::FlowKeyMux );
 GENERATE_PROTOCOL_CONDUITS( mock_conduits::NetworkProtocol, \
                             mock_conduits::TCPProtocol,  mock_conduits::UDPProtocol, \
-                            mock_conduits::HTTPProtocol, mock_conduits::TLSProtocol, mock_conduits::DNSProtocol );
+                            mock_conduits::HTTPProtocol, mock_conduits::TLSProtocol, mock_conduits::DNSProtocol, \
+                            reconduits::StaticChain<mock_conduits::NetworkProtocol, mock_conduits::TCPProtocol>, \
+                            reconduits::AsyncBoundary<reconduits::SpscChannel<mock_conduits::Message>>, \
+                            reconduits::AsyncBoundary<reconduits::MpscChannel<mock_conduits::Message>>, \
+                            reconduits::AsyncBoundary<reconduits::FlowStrands<mock_conduits::Message, mock_conduits::MessageFlowHash>>, \
+                            reconduits::CreditGate<mock_conduits::Message>, reconduits::CreditReturn \
+                            MOCK_COROUTINE_PROTOCOLS );
 
 #include "ReConduitTypes.hpp"
 
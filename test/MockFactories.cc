@@ -17,9 +17,9 @@ reconduits::Conduit* NetworkFactory::create_tcp_connection(reconduits::Setup<Mes
     //                                               +-> |[a] connection_factoy [b]| --> | endpoint_adapter |
 
     using namespace reconduits;
-    auto tcp_parser        = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Protocol{ TCPProtocol{} } };
-    auto l4_mux            = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Mux{ L4LUAMux{} } };
-    auto connection_factoy = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Factory{ TCPConnectionFactory{} } };
+    auto tcp_parser        = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Protocol>, TCPProtocol{} };
+    auto l4_mux            = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Mux>, L4LUAMux{} };
+    auto connection_factoy = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Factory>, TCPConnectionFactory{} };
 
     tcp_parser->setSideB( *l4_mux );
     l4_mux->setSideB( *connection_factoy );
@@ -46,9 +46,9 @@ reconduits::Conduit* NetworkFactory::create_udp_connection(reconduits::Setup<Mes
     //                                               +-> |[a] connection_factoy [b]| --> | endpoint_adapter |
 
     using namespace reconduits;
-    auto udp_parser        = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Protocol{ UDPProtocol{} } };
-    auto l4_mux            = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Mux{ L4Mux{} } };
-    auto connection_factoy = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Factory{ UDPConnectionFactory{} } };
+    auto udp_parser        = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Protocol>, UDPProtocol{} };
+    auto l4_mux            = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Mux>, L4Mux{} };
+    auto connection_factoy = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Factory>, UDPConnectionFactory{} };
 
     udp_parser->setSideB( *l4_mux );
     l4_mux->setSideB( *connection_factoy );
@@ -64,6 +64,24 @@ reconduits::Conduit* NetworkFactory::create_udp_connection(reconduits::Setup<Mes
     return udp_parser;
 }
 
+reconduits::Conduit* NetworkFactory::route_to_sink(reconduits::Setup<Message>& msg, reconduits::Conduit*a, reconduits::Conduit* b) const
+{
+    //   ___________
+    //  /           |
+    // | l3_mux [bi]| --> | endpoint_adapter |
+    //  \___________|
+    //
+    // Protocols without conduits go straight to the default sink from now on,
+    // instead of coming back here for every packet.
+
+    auto& emsg = msg.get();
+    emsg.append( "NetworkFactory: Route unknown protocol to the default sink" );
+
+    auto key = emsg.getL3Id();
+    a->insertInSideB(key, *b);
+    return b;
+}
+
 bool TCPConnectionFactory::is_l4_connection_established(reconduits::Setup<Message>& msg) const
 {
     return msg.get().connection_established();
@@ -85,7 +103,7 @@ reconduits::Conduit* TCPConnectionFactory::select_application_protocol(reconduit
             using namespace reconduits;
             auto& emsg = msg.get();
             emsg.append( "TCPConnectionFactory: Setup HTTP connection" );
-            return new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Protocol{ HTTPProtocol{} } };
+            return new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Protocol>, HTTPProtocol{} };
         }
         case Message::tls_app_protocol:
         {
@@ -100,7 +118,7 @@ reconduits::Conduit* TCPConnectionFactory::select_application_protocol(reconduit
             using namespace reconduits;
             auto& emsg = msg.get();
             emsg.append( "TCPConnectionFactory: Setup TLS connection" );
-            return new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Protocol{ TLSProtocol{} } };
+            return new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Protocol>, TLSProtocol{} };
         }
         default: return nullptr;
     }
@@ -164,7 +182,7 @@ reconduits::Conduit* UDPConnectionFactory::create(reconduits::Setup<Message>& ms
     //      +-> |[a] connection_factoy [b]| -------------+
 
     using namespace reconduits;
-    auto dns_parser = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ Protocol{ DNSProtocol{} } };
+    auto dns_parser = new ( getFromPool<sizeof(Conduit)>() ) Conduit{ std::in_place_type<Protocol>, DNSProtocol{} };
 
     dns_parser->setSideB( *b );
 
@@ -28,7 +28,7 @@ public:
             switch( std::get<mock_packet::ProtocolType>( msg.get().getL3Id() ) ) {
                 case mock_packet::ProtocolType::tcp: return create_tcp_connection(msg, a, b);
                 case mock_packet::ProtocolType::udp: return create_udp_connection(msg, a, b);
-                default: return b;
+                default: return route_to_sink(msg, a, b);
             }
         } else if constexpr (std::is_same_v<T, reconduits::Release<Message>>) {
             return nullptr; // Do nothing
@@ -42,6 +42,7 @@ private:
 
     reconduits::Conduit* create_tcp_connection(reconduits::Setup<Message>& msg, reconduits::Conduit*a, reconduits::Conduit* b) const;
     reconduits::Conduit* create_udp_connection(reconduits::Setup<Message>& msg, reconduits::Conduit*a, reconduits::Conduit* b) const;
+    reconduits::Conduit* route_to_sink(reconduits::Setup<Message>& msg, reconduits::Conduit*a, reconduits::Conduit* b) const;
 };
 
 template<typename D>
@@ -6,6 +6,8 @@
 #include <utility>
 #include <chrono>
 #include <iostream>
+#include <string>
+#include <memory_resource>
 
 namespace mock_conduits {
 
@@ -18,8 +20,10 @@ public:
     Message(
         std::chrono::system_clock::time_point tp,
         const mock_packet::Packet& pkt,
-        bool uplink)
-        : packet_{ pkt }
+        bool uplink,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : msg_{ resource }
+        , packet_{ pkt }
         , time_stamp_{ tp }
         , uplink_{ uplink }
         , established_{}
@@ -33,9 +37,25 @@ public:
             std::tuple{packet_.get_dst_addr(), packet_.get_src_addr(), packet_.get_dst_port(), packet_.get_src_port()} };
     }
     constexpr bool isUpLink() const noexcept { return uplink_; }
+    auto timeStamp() const noexcept { return time_stamp_; }
 
     const auto& packet() const noexcept { return packet_; }
 
+    // Uplink message of a flow gone idle, flagged as timed out for TCP.
+    static Message idleTimeout(
+        std::chrono::system_clock::time_point tp,
+        mock_packet::ProtocolType proto,
+        const mock_packet::Packet::l4_id_type& flow,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    {
+        using namespace mock_packet;
+        auto [ src_addr, dst_addr, src_port, dst_port ] = flow;
+        IPv4Header network{ src_addr, dst_addr, proto };
+        if( proto == ProtocolType::tcp )
+            return Message{ tp, Packet{ network, TCPHeader{ src_port, dst_port, TCPHeader::set_ack_timeout_flags() } }, true, resource };
+        return Message{ tp, Packet{ network, UDPHeader{ src_port, dst_port } }, true, resource };
+    }
+
     bool connection_established() const { return established_; }
     void set_connection_established() { established_ = true; }
 
@@ -68,7 +88,7 @@ private:
         return o << "Message transist:\n-----------\n" << m.msg_ << "\n\n";
     }
 
-    std::string msg_;
+    std::pmr::string msg_;
 
     mock_packet::Packet packet_;
     std::chrono::system_clock::time_point time_stamp_;
@@ -76,4 +96,13 @@ private:
     bool established_;
 };
 
+// Same hash for both directions of a flow.
+struct MessageFlowHash
+{
+    std::size_t operator()(const Message& m) const noexcept
+    {
+        return std::size_t( m.packet().get_src_port() ^ m.packet().get_dst_port() );
+    }
+};
+
 }
@@ -4,14 +4,20 @@
 #include "MockLogger.hpp"
 #include "MockMessage.hpp"
 #include "MockTCPStateMachine.hpp"
+#include "ReConduitMemoryResource.hpp"
+#include "FlatFlowTable.hpp"
+#include "FlowAging.hpp"
+#include "MuxTable.hpp"
 
 #include "sol/sol.hpp"
 
 #include <unordered_map>
+#include <memory_resource>
 #include <utility>
 #include <type_traits>
 #include <string>
 #include <sstream>
+#include <chrono>
 
 namespace mock_conduits {
 
@@ -23,8 +29,8 @@ class L3Mux
 {
 public:
 
-    using key_type   = typename Message::key_type;
-    using value_type = reconduits::Conduit*;
+    using key_type   = typename mock_packet::Packet::l3_id_type;
+    using table_type = reconduits::MuxTable<key_type, reconduits::Conduit*, reconduits::FlowHash<key_type>, reconduits::DirectIndex<256>>;
 
     constexpr auto accept(auto&& msg, reconduits::Conduit*)
     {
@@ -35,46 +41,16 @@ public:
         return std::pair{ NextSide::b, make_variant_message( msg ) };
     }
 
-    auto find(auto&& msg) const
-    {
-        switch( std::get<mock_packet::ProtocolType>( msg.get().getL3Id() ) ) {
-            case mock_packet::ProtocolType::tcp:
-                return std::pair{ tcp_protocol_, tcp_protocol_ != nullptr };
-            case mock_packet::ProtocolType::udp:
-                return std::pair{ udp_protocol_, udp_protocol_ != nullptr };
-            default:
-                return std::pair{ static_cast<reconduits::Conduit*>( nullptr ), false };
-        }
-    }
+    auto& table() noexcept { return table_; }
 
-    auto insert(auto&& key, reconduits::Conduit& c)
+    auto routeKey(auto&& msg) const
     {
-        switch( std::get<mock_packet::ProtocolType>( key ) ) {
-            case mock_packet::ProtocolType::tcp:
-                return tcp_protocol_ = &c;
-            case mock_packet::ProtocolType::udp:
-                return udp_protocol_ = &c;
-            default:
-                return static_cast<reconduits::Conduit*>( nullptr );
-        }
-    }
-
-    auto setup(auto&& msg, reconduits::Conduit* conduit_origin) const
-    {
-        using namespace reconduits;
-        SPDLOG_DEBUG(getLogger(), "L3Mux [{:p}] is going to create new conduits.", static_cast<const void*>(this));
-        return make_variant_setup_message(msg, conduit_origin);
-    }
-
-    auto erase(auto&& key)
-    {
-        return static_cast<reconduits::Conduit*>( nullptr );
+        return std::get<key_type>( msg.get().getL3Id() );
     }
 
 protected:
 
-    value_type tcp_protocol_;
-    value_type udp_protocol_;
+    table_type table_;
 };
 
 class L4Mux
@@ -82,70 +58,82 @@ class L4Mux
 public:
 
     using key_type   = typename mock_packet::Packet::l4_id_type;
-    using value_type = reconduits::Conduit*;
+    using aging_type = reconduits::FlowAging<std::chrono::system_clock>;
+
+    // Idle timeouts are by application protocol.
+    static aging_type defaultAging()
+    {
+        using namespace std::chrono_literals;
+        aging_type aging{ 5min };
+        aging.idleTimeout( Message::dns_app_protocol, 30s );
+        return aging;
+    }
+
+    explicit L4Mux(aging_type aging = defaultAging(), std::pmr::memory_resource* resource = reconduits::getPoolResource())
+        : aging_{ std::move( aging ) }
+        , mux_table_{ resource }
+    {}
 
-    constexpr auto accept(auto&& msg, reconduits::Conduit* conduit_origin)
+    constexpr auto accept(auto&& msg, reconduits::Conduit* conduit_origin, auto* ctx)
     {
         auto& emsg = msg.get();
         SPDLOG_DEBUG(getLogger(), "L4Mux [{:p}] accepts a new message.", static_cast<void*>(this));
         emsg.append( "L4Mux" );
 
-        return accept_(msg, conduit_origin);
-    }
-
-    auto find(auto&& msg) const
-    {
-        //SPDLOG_DEBUG(getLogger(), "L4Mux [{0:p}] has{1}found key {2}.", static_cast<const void*>(this), (found ? " ":" NOT "),
-        //        std::get<mock_packet::Packet::l4_id_type>( msg.get().getL4Id() ));
-        return ctx_ptr_ ? std::pair{ctx_ptr_->next_conduit_, true} : std::pair{nullptr, false};
+        return accept_(msg, conduit_origin, ctx);
     }
 
-    auto insert(auto&& key, reconduits::Conduit& c)
-    {
-        SPDLOG_DEBUG(getLogger(), "L4Mux [{:p}] is going to connect new conduits.", static_cast<void*>(this));
-        if( ctx_ptr_ ) {
-            ctx_ptr_->next_conduit_ = &c;
-            return &c;
-        } else {
-            //getLogger()->warn("The new connection for key {} was not possible.", std::get<mock_packet::Packet::l4_id_type>( key ));
-            return static_cast<reconduits::Conduit*>( nullptr );
-        }
-    }
+    // No flowKey(): the table gives the route with the flow context, and a
+    // route cache in front of it only adds a lookup. Route caches hit about
+    // 64% of packets of random flows, and their misses still go to the table
+    // (bench/route_cache_bench.cc: 30 against 15 ns at 64K flows).
+    auto& table() noexcept { return mux_table_; }
 
-    auto setup(auto&& msg, reconduits::Conduit* conduit_origin) const
+    auto routeKey(auto&& msg) const
     {
-        using namespace reconduits;
-        SPDLOG_DEBUG(getLogger(), "L4Mux [{:p}] is going to create new conduits.", static_cast<const void*>(this));
-        return make_variant_setup_message(msg, conduit_origin);
+        return std::get<key_type>( msg.get().getL4Id() );
     }
 
-    auto erase(auto&& key)
+    // Flows idle for longer than their protocol allows are released as if
+    // they had timed out, with the L4 protocol of the flow rather than that
+    // of the message going by.
+    void expire(auto&& msg, auto&& release)
     {
-        SPDLOG_DEBUG(getLogger(), "L4Mux [{:p}] is going to release connected conduits.", static_cast<void*>(this));
-        auto it = mux_table_.find( std::get<mock_packet::Packet::l4_id_type>( key ) );
-        if( it != mux_table_.cend() ) {
-            mux_table_.erase( it );
-            return it->second.next_conduit_;
-        } else
-            return static_cast<reconduits::Conduit*>( nullptr );
+        const auto& emsg = msg.get();
+        aging_.sweep( mux_table_, emsg.timeStamp(), [ & ](const key_type& key)
+        {
+            SPDLOG_DEBUG(getLogger(), "L4Mux [{:p}] found an idle connection.", static_cast<void*>(this));
+            auto expired = Message::idleTimeout( emsg.timeStamp(), std::as_const( mux_table_ ).find( key )->proto_, key );
+            release( expired );
+        } );
     }
 
 protected:
 
-    constexpr auto accept_(auto&& msg, reconduits::Conduit* conduit_origin)
+    struct ConnectionContext
+    {
+        reconduits::Conduit* next_conduit_;
+        mock_state_machine::TCPStateMachine connection_state_;
+        reconduits::FlowAge<aging_type::clock_type> age_;
+        mock_packet::ProtocolType proto_;
+    };
+
+    // The context of the flow, found by the Mux conduit, is only created here.
+    constexpr auto accept_(auto&& msg, reconduits::Conduit* conduit_origin, ConnectionContext* ctx)
     {
         using namespace reconduits;
         auto& emsg = msg.get();
-        if( ( ctx_ptr_ = select_context( emsg ) ) ) {
+        if( ctx ) {
 
-            auto prev_state = update_connection_state( emsg );
+            ctx->age_.touch( emsg.timeStamp() );
+            auto prev_state = update_connection_state( *ctx, emsg );
 
-            if( is_connection_established( prev_state ) ) {
+            if( is_connection_established( *ctx, prev_state ) ) {
                 return std::pair{ NextSide::b, make_variant_message( msg ) };
-            } else if( is_connection_closed() ) {
+            } else if( is_connection_closed( *ctx ) ) {
                 return std::pair{ NextSide::b0, make_variant_release_message(msg, conduit_origin) };
             } else {
-                if( is_connection_establishing( prev_state ) ) emsg.set_connection_established();
+                if( is_connection_establishing( *ctx, prev_state ) ) emsg.set_connection_established();
                 return std::pair{ NextSide::b0, make_variant_setup_message(msg, conduit_origin) };
             }
         } else {
@@ -154,87 +142,62 @@ protected:
         }
     }
 
-    struct key_hash : public std::unary_function<key_type, std::size_t>
-    {
-       std::size_t operator()(const key_type& k) const
-       {
-          return std::get<0>( k ) ^ std::get<1>( k ) ^
-                 std::get<2>( k ) ^ std::get<3>( k );
-       }
-    };
-
-    struct key_equal : public std::binary_function<key_type, key_type, bool>
-    {
-       bool operator()(const key_type& v0, const key_type& v1) const
-       {
-          return  std::get<0>( v0 ) == std::get<0>( v1 ) &&
-                  std::get<1>( v0 ) == std::get<1>( v1 ) &&
-                  std::get<2>( v0 ) == std::get<2>( v1 ) &&
-                  std::get<3>( v0 ) == std::get<3>( v1 );
-       }
-    };
-
-    struct ConnectionContext
-    {
-        reconduits::Conduit* next_conduit_;
-        mock_state_machine::TCPStateMachine connection_state_;
-    };
-
-    auto select_context(const auto& emsg)
-    {
-        auto it = mux_table_.find( std::get<mock_packet::Packet::l4_id_type>( emsg.getL4Id() ) );
-        return it != mux_table_.cend() ? &it->second : nullptr;
-    }
-
     auto create_context(const auto& emsg)
     {
-        auto [it, inserted] = mux_table_.emplace(std::get<mock_packet::Packet::l4_id_type>( emsg.getL4Id() ), ConnectionContext{nullptr, mock_state_machine::TCPStateMachine{}});
+        auto [ctx, inserted] = mux_table_.try_emplace(std::get<key_type>( emsg.getL4Id() ), nullptr, mock_state_machine::TCPStateMachine{},
+                                                      aging_.age( emsg.app_proto(), emsg.timeStamp() ), emsg.packet().get_proto());
         if( inserted ) {
             const auto& pkt = emsg.packet();
-            it->second.connection_state_.transition( mock_state_machine::Event{ pkt.is_ack(), pkt.is_syn(), pkt.is_fin(), pkt.is_timeout() } );
+            ctx->connection_state_.transition( mock_state_machine::Event{ pkt.is_ack(), pkt.is_syn(), pkt.is_fin(), pkt.is_timeout() } );
         }
     }
 
-    constexpr bool is_connection_establishing(mock_state_machine::TCPStateMachine prev_state) const noexcept
+    static constexpr bool is_connection_establishing(const ConnectionContext& ctx, mock_state_machine::TCPStateMachine prev_state) noexcept
     {
-        return ctx_ptr_->connection_state_.is_current<mock_state_machine::Established>() &&
+        return ctx.connection_state_.is_current<mock_state_machine::Established>() &&
                prev_state.is_current<mock_state_machine::SynReceived>();
     }
 
-    constexpr bool is_connection_established(mock_state_machine::TCPStateMachine prev_state) const noexcept
+    static constexpr bool is_connection_established(const ConnectionContext& ctx, mock_state_machine::TCPStateMachine prev_state) noexcept
     {
-        return ctx_ptr_->connection_state_.is_current<mock_state_machine::Established>() &&
+        return ctx.connection_state_.is_current<mock_state_machine::Established>() &&
                prev_state.is_current<mock_state_machine::Established>();
     }
 
-    constexpr bool is_connection_closed() const noexcept
+    static constexpr bool is_connection_closed(const ConnectionContext& ctx) noexcept
     {
-        return ctx_ptr_->connection_state_.is_current<mock_state_machine::Closed>();
+        return ctx.connection_state_.is_current<mock_state_machine::Closed>();
     }
 
-    auto update_connection_state(auto&& emsg)
+    static auto update_connection_state(ConnectionContext& ctx, auto&& emsg)
     {
         const auto& pkt = emsg.packet();
-        return ctx_ptr_->connection_state_.transition( mock_state_machine::Event{ pkt.is_ack(), pkt.is_syn(), pkt.is_fin(), pkt.is_timeout() } );
+        return ctx.connection_state_.transition( mock_state_machine::Event{ pkt.is_ack(), pkt.is_syn(), pkt.is_fin(), pkt.is_timeout() } );
     }
 
-    using mux_table_type = std::unordered_map<key_type, ConnectionContext, key_hash, key_equal>;
+    // Grows incrementally: growing in one shot stalls a packet for the whole
+    // table (hundreds of ms at 8M flows), against a few us at p99 for the
+    // insertions paying for growth here (see bench/rehash_bench.cc).
+    using mux_table_type = reconduits::MuxTable<key_type, ConnectionContext, reconduits::FlowHash<key_type>,
+                                                reconduits::HashedKeys<reconduits::IncrementalRehash<>>>;
+    aging_type aging_;
     mux_table_type mux_table_;
-    ConnectionContext* ctx_ptr_ = nullptr;
 };
 
 class L4LUAMux : public L4Mux
 {
 public:
 
-    constexpr auto accept(auto&& msg, reconduits::Conduit* conduit_origin)
+    using L4Mux::L4Mux;
+
+    constexpr auto accept(auto&& msg, reconduits::Conduit* conduit_origin, auto* ctx)
     {
         SPDLOG_DEBUG(getLogger(), "L4LUAMux [{:p}] accepts a new message.", static_cast<void*>(this));
         auto& emsg = msg.get();
         lua.set_function("append", [ & ]{ emsg.append( "L4LUAMux" ); });
         lua.script("append()");
 
-        return accept_(msg, conduit_origin);
+        return accept_(msg, conduit_origin, ctx);
     }
 
 private:
@@ -242,4 +205,50 @@ private:
     sol::state lua;
 };
 
+// Mux of L4 flows through a map of its own, routed by the Mux conduit
+// through its route cache. Counts the lookups which miss the cache.
+class FlowKeyMux
+{
+public:
+
+    using key_type = typename mock_packet::Packet::l4_id_type;
+
+    explicit FlowKeyMux(std::size_t* finds) : routes_{}, finds_{ finds } {}
+
+    constexpr auto accept(auto&& msg, reconduits::Conduit*)
+    {
+        using namespace reconduits;
+        using T = std::decay_t<decltype(msg)>;
+        msg.get().append( "FlowKeyMux" );
+        if constexpr ( std::is_same_v<T, Release<Message>> ) return std::pair{ NextSide::b0, make_variant_message( msg ) };
+        else return std::pair{ NextSide::b, make_variant_message( msg ) };
+    }
+
+    auto flowKey(auto&& msg) const { return std::get<key_type>( msg.get().getL4Id() ); }
+
+    std::pair<reconduits::Conduit*, bool> find(auto&& msg)
+    {
+        ++*finds_;
+        auto route = routes_.find( flowKey( msg ) );
+        if( route == routes_.end() ) return { nullptr, false };
+        return { route->second, true };
+    }
+
+    reconduits::Conduit* insert(auto&& key, reconduits::Conduit& c) { return routes_[ std::get<key_type>( key ) ] = &c; }
+
+    reconduits::Conduit* erase(auto&& key)
+    {
+        auto route = routes_.find( std::get<key_type>( key ) );
+        if( route == routes_.end() ) return nullptr;
+        auto next = route->second;
+        routes_.erase( route );
+        return next;
+    }
+
+private:
+
+    std::unordered_map<key_type, reconduits::Conduit*, reconduits::FlowHash<key_type>> routes_;
+    std::size_t* finds_;
+};
+
 }
@@ -14,7 +14,7 @@
 
 namespace mock_packet {
 
-enum class ProtocolType { tcp = 6, udp = 17 };
+enum class ProtocolType { icmp = 1, tcp = 6, udp = 17, gre = 47, esp = 50, sctp = 132 };
 
 class IPv4Header
 {
@@ -25,6 +25,12 @@ public:
         , proto_{ proto }
     {}
 
+    IPv4Header(in_addr_t src, in_addr_t dst, ProtocolType proto)
+        : src_{ src }
+        , dst_{ dst }
+        , proto_{ proto }
+    {}
+
     auto get_src_addr() const noexcept { return src_; }
     auto get_dst_addr() const noexcept { return dst_; }
     auto get_proto() const noexcept { return proto_; }
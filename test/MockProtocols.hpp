@@ -3,6 +3,7 @@
 #include "ReConduitTypesGenerators.hpp"
 #include "MockLogger.hpp"
 #include "MockMessage.hpp"
+#include "CoroutineProtocol.hpp"
 
 #include "sol/sol.hpp"
 
@@ -26,6 +27,12 @@ struct NetworkProtocol
         emsg.append( "NetworkProtocol" );
         return std::pair{ NextSide::b, make_variant_message( msg ) };
     }
+
+    constexpr auto acceptBatch(auto&& batch, reconduits::Conduit*)
+    {
+        for( auto m : batch ) m->append( "NetworkProtocol" );
+        return std::pair{ reconduits::NextSide::b, batch };
+    }
 };
 
 struct TCPProtocol
@@ -82,4 +89,22 @@ struct DNSProtocol
         return std::pair{ NextSide::b, make_variant_release_message(msg, conduit_origin) };
     }
 };
+
+#ifdef __cpp_impl_coroutine
+// ClientHello split over two segments: a copy of the first one is held back
+// until the second one completes it, and both go on then.
+struct TLSHelloParser
+{
+    reconduits::ChunkTask<Message> operator()()
+    {
+        using namespace reconduits;
+        Message first = co_await next_chunk();
+        first.append( "TLSHelloParser waits for more" );
+        auto& second = co_await next_chunk( NextSide::done );
+        co_await emit( first );
+        second.append( "TLSHelloParser has a ClientHello" );
+    }
+};
+#endif
+
 }
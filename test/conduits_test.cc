@@ -4,6 +4,7 @@
 #include "MockMessage.hpp"
 
 #include "MockConduitTypes.hpp"
+#include "ShardedRuntime.hpp"
 #include "sol/sol.hpp"
 
 #include <unordered_map>
@@ -20,6 +21,133 @@ inline auto getLogger(std::string logger_name = "reconduit_test")
 
 template<typename T> struct PrintType;
 
+//////////////////////////////////////
+// Traffic
+//////////////////////////////////////
+
+namespace {
+
+using namespace mock_packet;
+
+// TCP connection example
+
+// HTTP Connection
+
+const Packet tcp_http_packets[] = {
+// tcp_http_packets[1] > SYN
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 80, TCPHeader::set_syn_flag() }
+    },
+// tcp_http_packets[2] < SYN_ACK
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 80, 55000, TCPHeader::set_syn_ack_flags() }
+    },
+// tcp_http_packets[3] > ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 80, TCPHeader::set_ack_flag() }
+    },
+// tcp_http_packets[4] > ACK [ GET URL ]
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 80, TCPHeader::set_ack_flag() },
+      HTTPHeader{ "http://www.recoduit.cxm/" }
+    },
+// tcp_http_packets[5] < ACK [ 200 OK ]
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 80, 55000, TCPHeader::set_ack_flag() },
+      HTTPHeader{ "200 OK" }
+    },
+// tcp_http_packets[6] > FIN ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 80, TCPHeader::set_fin_flag() }
+    },
+// tcp_http_packets[7] < ACK
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 80, 55000, TCPHeader::set_ack_flag() }
+    },
+// tcp_http_packets[8] < FIN
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 80, 55000, TCPHeader::set_fin_flag() }
+    },
+// tcp_http_packets[9] > ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 80, TCPHeader::set_ack_timeout_flags() }
+    }
+};
+
+// TLS Connection
+
+const Packet tcp_tls_packets[] = {
+// tcp_tls_packets[1] > SYN
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 443, TCPHeader::set_syn_flag() }
+    },
+// tcp_tls_packets[2] < SYN_ACK
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 443, 55000, TCPHeader::set_syn_ack_flags() }
+    },
+// tcp_tls_packets[3] > ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 443, TCPHeader::set_ack_flag() }
+    },
+// tcp_tls_packets[4] > ACK [ CLIENT HELLO ]
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 443, TCPHeader::set_ack_flag() },
+      TLSHeader{ "www.recoduit.cxm" }
+    },
+// tcp_tls_packets[5] < ACK [ SERVER HELLO ]
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 443, 55000, TCPHeader::set_ack_flag() },
+      TLSHeader{ "http2" }
+    },
+// tcp_tls_packets[6] > FIN ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 443, TCPHeader::set_fin_flag() }
+    },
+// tcp_tls_packets[7] < ACK
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 443, 55000, TCPHeader::set_ack_flag() }
+    },
+// tcp_tls_packets[8] < FIN
+    {
+      IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
+      TCPHeader{ 443, 55000, TCPHeader::set_fin_flag() }
+    },
+// tcp_tls_packets[9] > ACK
+    {
+      IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
+      TCPHeader{ 55000, 443, TCPHeader::set_ack_timeout_flags() }
+    }
+};
+const bool uplinks[] = {
+    true,  // 1 syn
+    false, // 2 syn_ack
+    true,  // 3 ack
+    true,  // 4 GET
+    false, // 5 200 OK
+    true,  // 6 fin_ack
+    false, // 7 ack
+    false, // 8 fin_ack
+    true,  // 9 fin
+};
+
+}
+
 //////////////////////////////////////
 // Tests
 //////////////////////////////////////
@@ -65,125 +193,6 @@ TEST(ConduitTest, MockDPIexample) {
     network_factory.setSideA( l3_mux );
     network_factory.setSideB( endpoint_adapter );
 
-    // TCP connection example
-
-    // HTTP Connection
-
-    using namespace mock_packet;
-    const Packet tcp_http_packets[] = {
-    // tcp_http_packets[1] > SYN
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 80, TCPHeader::set_syn_flag() }
-        },
-    // tcp_http_packets[2] < SYN_ACK
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 80, 55000, TCPHeader::set_syn_ack_flags() }
-        },
-    // tcp_http_packets[3] > ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 80, TCPHeader::set_ack_flag() }
-        },
-    // tcp_http_packets[4] > ACK [ GET URL ]
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 80, TCPHeader::set_ack_flag() },
-          HTTPHeader{ "http://www.recoduit.cxm/" }
-        },
-    // tcp_http_packets[5] < ACK [ 200 OK ]
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 80, 55000, TCPHeader::set_ack_flag() },
-          HTTPHeader{ "200 OK" }
-        },
-    // tcp_http_packets[6] > FIN ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 80, TCPHeader::set_fin_flag() }
-        },
-    // tcp_http_packets[7] < ACK
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 80, 55000, TCPHeader::set_ack_flag() }
-        },
-    // tcp_http_packets[8] < FIN
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 80, 55000, TCPHeader::set_fin_flag() }
-        },
-    // tcp_http_packets[9] > ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 80, TCPHeader::set_ack_timeout_flags() }
-        }
-    };
-
-    // TLS Connection
-
-    using namespace mock_packet;
-    const Packet tcp_tls_packets[] = {
-    // tcp_tls_packets[1] > SYN
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 443, TCPHeader::set_syn_flag() }
-        },
-    // tcp_tls_packets[2] < SYN_ACK
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 443, 55000, TCPHeader::set_syn_ack_flags() }
-        },
-    // tcp_tls_packets[3] > ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 443, TCPHeader::set_ack_flag() }
-        },
-    // tcp_tls_packets[4] > ACK [ CLIENT HELLO ]
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 443, TCPHeader::set_ack_flag() },
-          TLSHeader{ "www.recoduit.cxm" }
-        },
-    // tcp_tls_packets[5] < ACK [ SERVER HELLO ]
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 443, 55000, TCPHeader::set_ack_flag() },
-          TLSHeader{ "http2" }
-        },
-    // tcp_tls_packets[6] > FIN ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 443, TCPHeader::set_fin_flag() }
-        },
-    // tcp_tls_packets[7] < ACK
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 443, 55000, TCPHeader::set_ack_flag() }
-        },
-    // tcp_tls_packets[8] < FIN
-        {
-          IPv4Header{ "200.100.90.80", "10.11.12.13", ProtocolType::tcp }, // Down
-          TCPHeader{ 443, 55000, TCPHeader::set_fin_flag() }
-        },
-    // tcp_tls_packets[9] > ACK
-        {
-          IPv4Header{ "10.11.12.13", "200.100.90.80", ProtocolType::tcp }, // Up
-          TCPHeader{ 55000, 443, TCPHeader::set_ack_timeout_flags() }
-        }
-    };
-    bool uplinks[] = {
-        true,  // 1 syn
-        false, // 2 syn_ack
-        true,  // 3 ack
-        true,  // 4 GET
-        false, // 5 200 OK
-        true,  // 6 fin_ack
-        false, // 7 ack
-        false, // 8 fin_ack
-        true,  // 9 fin
-    };
-
     for(auto i = 0u; i < sizeof tcp_http_packets / sizeof tcp_http_packets[0]; ++i) {
 
         // HTTP
@@ -192,8 +201,11 @@ TEST(ConduitTest, MockDPIexample) {
         if( i == 3 ) { EXPECT_EQ(tcp_http_packets[i].get_app_proto<HTTPHeader>().get_url(), "http://www.recoduit.cxm/"); }
         if( i == 4 ) { EXPECT_EQ(tcp_http_packets[i].get_app_proto<HTTPHeader>().get_response_code(), "200 OK"); }
 
+        // Per message trace allocations, released at once at the end of the iteration.
+        MonotonicArena message_arena;
+
         auto now = chrono::system_clock::now();
-        Message tcp_http_msg{now, tcp_http_packets[i], uplinks[i]};
+        Message tcp_http_msg{now, tcp_http_packets[i], uplinks[i], &message_arena};
         network_adapter.accept( InformationChunk<Message>{ tcp_http_msg } );
         std::cout << i + 1 << ".- HTTP packet:\n" << tcp_http_msg;
 
@@ -204,7 +216,7 @@ TEST(ConduitTest, MockDPIexample) {
         if( i == 4 ) { EXPECT_EQ(tcp_tls_packets[i].get_app_proto<TLSHeader>().get_application_layer_protocol_negociation(), "http2"); }
 
         now = chrono::system_clock::now();
-        Message tcp_tls_msg{now, tcp_tls_packets[i], uplinks[i]};
+        Message tcp_tls_msg{now, tcp_tls_packets[i], uplinks[i], &message_arena};
         network_adapter.accept( InformationChunk<Message>{ tcp_tls_msg } );
         std::cout << i + 1 << ".- TLS packet:\n" << tcp_tls_msg;
     }
@@ -228,3 +240,930 @@ TEST(ConduitTest, MockDPIexample) {
 //    std::cout << udp_msg;
 }
 
+
+namespace {
+
+// The graph of MockDPIexample, for tests needing more than one of them.
+struct DPIGraph
+{
+    DPIGraph()
+    {
+        network_adapter.setSideA( network_protocol );
+        network_protocol.setSideB( l3_mux );
+        l3_mux.setSideB( network_factory );
+        network_factory.setSideA( l3_mux );
+        network_factory.setSideB( endpoint_adapter );
+    }
+
+    reconduits::Conduit network_adapter{ reconduits::Adapter{ mock_conduits::NetworkAdapter{} } };
+    reconduits::Conduit endpoint_adapter{ reconduits::Adapter{ mock_conduits::EndPointAdapter{} } };
+    reconduits::Conduit network_protocol{ reconduits::Protocol{ mock_conduits::NetworkProtocol{} } };
+    reconduits::Conduit l3_mux{ reconduits::Mux{ mock_conduits::L3Mux{} } };
+    reconduits::Conduit network_factory{ reconduits::Factory{ mock_conduits::NetworkFactory{} } };
+};
+
+}
+
+TEST(ConduitTest, BatchesMatchSingleMessages) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    DPIGraph one_by_one_graph;
+    DPIGraph batch_graph;
+
+    MonotonicArena message_arena;
+    vector<Message> one_by_one;
+    vector<Message> in_batch;
+
+    auto now = chrono::system_clock::now();
+    for(auto i = 0u; i < sizeof tcp_http_packets / sizeof tcp_http_packets[0]; ++i) {
+        for( auto& packet : { tcp_http_packets[i], tcp_tls_packets[i] } ) {
+            one_by_one.emplace_back(now, packet, uplinks[i], &message_arena);
+            in_batch.emplace_back(now, packet, uplinks[i], &message_arena);
+        }
+    }
+
+    for( auto& msg : one_by_one ) one_by_one_graph.network_adapter.accept( InformationChunk<Message>{ msg } );
+
+    // Interleaved flows are split by the muxes, and the TCP and application
+    // protocols, which do not take batches, get their messages one by one.
+    vector<Message*> items;
+    for( auto& msg : in_batch ) items.push_back( &msg );
+    batch_graph.network_adapter.accept( Batch<Message>{ items.data(), items.size() } );
+
+    for(auto i = 0u; i < one_by_one.size(); ++i) {
+        ostringstream expected, actual;
+        expected << one_by_one[i];
+        actual << in_batch[i];
+        EXPECT_EQ( expected.str(), actual.str() ) << "message " << i;
+    }
+
+    ostringstream get_trace;
+    get_trace << in_batch[6];
+    EXPECT_NE( get_trace.str().find( "HTTPProtocol" ), string::npos );
+}
+
+TEST(ConduitTest, UnknownProtocolsGoToTheDefaultSink) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+    using namespace mock_packet;
+
+    DPIGraph graph;
+    MonotonicArena message_arena;
+    auto now = chrono::system_clock::now();
+
+    // Only the first packet of every protocol without conduits gets to the
+    // factory, the rest find their way to the sink in the L3 mux.
+    for( auto proto : { ProtocolType::icmp, ProtocolType::gre, ProtocolType::esp, ProtocolType::sctp } ) {
+        for( auto i = 0; i < 3; ++i ) {
+            Packet packet{ IPv4Header{ "10.11.12.13", "200.100.90.80", proto }, UDPHeader{ 0, 0 } };
+            Message msg{ now, packet, true, &message_arena };
+            graph.network_adapter.accept( InformationChunk<Message>{ msg } );
+
+            ostringstream trace;
+            trace << msg;
+            EXPECT_EQ( trace.str().find( "NetworkFactory" ) != string::npos, i == 0 ) << trace.str();
+            EXPECT_NE( trace.str().find( "EndPointAdapter" ), string::npos ) << trace.str();
+        }
+    }
+}
+
+TEST(ConduitTest, KeysOfAnotherKindAreNotRouted) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | l4_mux [b0] | --> | recorder |
+    vector<string> traces;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+    Conduit l4_mux{ Mux{ L4Mux{} } };
+    l4_mux.setSideB( recorder );
+
+    // An L3 key, in the variant factories route with, leaves the L4 table
+    // alone: both messages of the flow still go to side B0.
+    Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+    EXPECT_EQ( l4_mux.insertInSideB( msg.getL3Id(), recorder ), nullptr );
+    EXPECT_EQ( l4_mux.eraseFromSideB( msg.getL3Id() ), nullptr );
+    l4_mux.accept( InformationChunk<Message>{ msg } );
+    l4_mux.accept( InformationChunk<Message>{ msg } );
+    EXPECT_EQ( traces.size(), 2u );
+}
+
+TEST(ConduitTest, StaticChainMatchesConnectedProtocols) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | adapter [a] | --> | network_protocol [b] | --> | tcp_protocol [b] | --> | endpoint_adapter |
+    Conduit adapter{ Adapter{ NetworkAdapter{} } };
+    Conduit network_protocol{ Protocol{ NetworkProtocol{} } };
+    Conduit tcp_protocol{ Protocol{ TCPProtocol{} } };
+    Conduit endpoint_adapter{ Adapter{ EndPointAdapter{} } };
+    adapter.setSideA( network_protocol );
+    network_protocol.setSideB( tcp_protocol );
+    tcp_protocol.setSideB( endpoint_adapter );
+
+    // | chain_adapter [a] | --> | chain [b] | --> | chain_endpoint_adapter |
+    Conduit chain_adapter{ Adapter{ NetworkAdapter{} } };
+    Conduit chain{ Protocol{ StaticChain<NetworkProtocol, TCPProtocol>{} } };
+    Conduit chain_endpoint_adapter{ Adapter{ EndPointAdapter{} } };
+    chain_adapter.setSideA( chain );
+    chain.setSideB( chain_endpoint_adapter );
+
+    auto now = chrono::system_clock::now();
+    Message connected_msg{now, tcp_http_packets[0], uplinks[0]};
+    Message chain_msg{now, tcp_http_packets[0], uplinks[0]};
+    adapter.accept( InformationChunk<Message>{ connected_msg } );
+    chain_adapter.accept( InformationChunk<Message>{ chain_msg } );
+
+    ostringstream expected, actual;
+    expected << connected_msg;
+    actual << chain_msg;
+    EXPECT_EQ( expected.str(), actual.str() );
+    EXPECT_NE( actual.str().find( "TCPProtocol\nEndPointAdapter" ), string::npos );
+}
+
+TEST(ConduitTest, LoopsAreCutAfterMaxHops) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | ping [b] | --> | pong [b] | --+
+    //      ^                         |
+    //      +-------------------------+
+    Conduit ping{ Protocol{ TCPProtocol{} } };
+    Conduit pong{ Protocol{ TCPProtocol{} } };
+    ping.setSideB( pong );
+    pong.setSideB( ping );
+
+    Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+    ping.accept( InformationChunk<Message>{ msg } );
+
+    ostringstream trace;
+    trace << msg;
+    auto s = trace.str();
+    auto hops = 0u;
+    for( auto pos = s.find( "TCPProtocol" ); pos != string::npos; pos = s.find( "TCPProtocol", pos + 1 ) ) ++hops;
+    EXPECT_EQ( hops, RECONDUIT_MAX_HOPS );
+}
+
+TEST(ConduitTest, BatchLoopsAreCutAfterMaxHops) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | l3_mux [b] | --> | network [b] | --+
+    //      ^                             |
+    //      +-----------------------------+
+    // The mux splits the batch on every lap, handing the sub-batch on to the
+    // walk, which counts its hops on rather than nesting another walk.
+    Conduit l3_mux{ Mux{ L3Mux{} } };
+    Conduit network{ Protocol{ NetworkProtocol{} } };
+    network.setSideB( l3_mux );
+
+    auto now = chrono::system_clock::now();
+    vector<Message> msgs{ Message{now, tcp_http_packets[0], uplinks[0]}, Message{now, tcp_http_packets[1], uplinks[1]} };
+    l3_mux.insertInSideB(msgs[0].getL3Id(), network);
+    l3_mux.insertInSideB(msgs[1].getL3Id(), network);
+    vector<Message*> items{ &msgs[0], &msgs[1] };
+    l3_mux.accept( Batch<Message>{ items.data(), items.size() } );
+
+    for( auto& msg : msgs ) {
+        ostringstream trace;
+        trace << msg;
+        auto s = trace.str();
+        auto laps = 0u;
+        for( auto pos = s.find( "NetworkProtocol" ); pos != string::npos; pos = s.find( "NetworkProtocol", pos + 1 ) ) ++laps;
+        EXPECT_EQ( laps, RECONDUIT_MAX_HOPS / 2 );
+    }
+}
+
+TEST(ConduitTest, SingleBlockConduits) {
+
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    using tcp_layout = ConduitLayout<Protocol, TCPProtocol>;
+    EXPECT_EQ( tcp_layout::single_block, RECONDUIT_SINGLE_BLOCK_CONDUITS != 0 );
+    EXPECT_LE( tcp_layout::size, cache_line_size );
+    EXPECT_GE( tcp_layout::user_offset, sizeof(Protocol) );
+
+    // User state survives being moved next to its kind wrapper.
+    Conduit l4_mux{ Mux{ L4LUAMux{} } };
+    Conduit endpoint_adapter{ Adapter{ EndPointAdapter{} } };
+    l4_mux.setSideB( endpoint_adapter );
+
+    Message msg{std::chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+    l4_mux.accept( InformationChunk<Message>{ msg } );
+    std::ostringstream trace;
+    trace << msg;
+    EXPECT_NE( trace.str().find( "L4LUAMux" ), std::string::npos );
+
+    // So does the user state of conduits built right around it.
+    Conduit in_place_mux{ std::in_place_type<Mux>, L4LUAMux{} };
+    in_place_mux.setSideB( endpoint_adapter );
+
+    Message in_place_msg{std::chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+    in_place_mux.accept( InformationChunk<Message>{ in_place_msg } );
+    std::ostringstream in_place_trace;
+    in_place_trace << in_place_msg;
+    EXPECT_EQ( in_place_trace.str(), trace.str() );
+}
+
+TEST(ConduitTest, RouteCache) {
+
+    using namespace reconduits;
+    using key_type = mock_packet::Packet::l4_id_type;
+
+    RouteCache<key_type> cache;
+    Conduit* http = reinterpret_cast<Conduit*>( 0x1000 );
+    Conduit* tls  = reinterpret_cast<Conduit*>( 0x2000 );
+    key_type http_key{ 1, 2, 55000, 80 };
+    key_type tls_key{ 1, 2, 55000, 443 };
+
+    EXPECT_EQ( cache.find( http_key ), nullptr );
+    cache.insert(http_key, http);
+    cache.insert(tls_key, tls);
+    EXPECT_EQ( cache.find( http_key ), http );
+    EXPECT_EQ( cache.find( tls_key ), tls );
+
+    // Erase drops one entry only.
+    cache.erase( tls_key );
+    EXPECT_EQ( cache.find( tls_key ), nullptr );
+    EXPECT_EQ( cache.find( http_key ), http );
+
+    // The cache grows along with the flows. Consecutive ports are spread as
+    // randomly as any flows, so some of them collide.
+    auto capacity = cache.capacity();
+    auto flows = static_cast<std::uint16_t>( 4 * capacity );
+    for( auto port = std::uint16_t{ 1 }; port <= flows; ++port ) cache.insert(key_type{ 3, 4, port, 80 }, tls);
+    EXPECT_GE( cache.capacity(), 4 * capacity );
+    EXPECT_GT( cache.size(), capacity );
+    EXPECT_LT( cache.size(), flows );
+    EXPECT_EQ( cache.find( key_type{ 3, 4, flows, 80 } ), tls );
+
+    // Reversed tuples are different flows.
+    EXPECT_NE( FlowHash<key_type>{}( key_type{ 1, 2, 3, 4 } ), FlowHash<key_type>{}( key_type{ 2, 1, 4, 3 } ) );
+}
+
+TEST(ConduitTest, RouteCacheOfFlowKeyMuxes) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    vector<string> first_traces, second_traces, released_traces;
+    Conduit first{ Adapter{ RecorderAdapter{ &first_traces } } };
+    Conduit second{ Adapter{ RecorderAdapter{ &second_traces } } };
+    Conduit released{ Adapter{ RecorderAdapter{ &released_traces } } };
+
+    size_t finds = 0;
+    Conduit mux{ Mux{ FlowKeyMux{ &finds } } };
+    mux.setSideB( released );
+
+    MonotonicArena message_arena;
+    auto now = chrono::system_clock::now();
+    Message http{ now, tcp_http_packets[0], uplinks[0], &message_arena };
+    Message tls{ now, tcp_tls_packets[0], uplinks[0], &message_arena };
+    mux.insertInSideB(http.getL4Id(), first);
+    mux.insertInSideB(tls.getL4Id(), first);
+
+    // Only the first message of every flow looks its route up in the mux.
+    for( auto i = 0; i < 3; ++i ) {
+        mux.accept( InformationChunk<Message>{ http } );
+        mux.accept( InformationChunk<Message>{ tls } );
+    }
+    EXPECT_EQ( finds, 2u );
+    EXPECT_EQ( first_traces.size(), 6u );
+
+    // A new route drops the cached route of its own flow only.
+    mux.insertInSideB(http.getL4Id(), second);
+    mux.accept( InformationChunk<Message>{ http } );
+    mux.accept( InformationChunk<Message>{ tls } );
+    EXPECT_EQ( finds, 3u );
+    EXPECT_EQ( second_traces.size(), 1u );
+    EXPECT_EQ( first_traces.size(), 7u );
+
+    // So does a flow being released...
+    mux.accept( Release<Message>{ http, &mux } );
+    EXPECT_EQ( released_traces.size(), 1u );
+    mux.accept( InformationChunk<Message>{ http } );
+    mux.accept( InformationChunk<Message>{ tls } );
+    EXPECT_EQ( finds, 4u );
+    EXPECT_EQ( second_traces.size(), 2u );
+
+    // ... or erased by a factory.
+    EXPECT_EQ( mux.eraseFromSideB( tls.getL4Id() ), &first );
+    mux.accept( InformationChunk<Message>{ tls } );
+    EXPECT_EQ( finds, 5u );
+    EXPECT_EQ( first_traces.size(), 8u );
+    EXPECT_EQ( released_traces.size(), 2u );
+}
+
+namespace {
+
+// Senders push numbered messages through a boundary of type Channel into
+// | boundary | ~~> | tcp_protocol [b] | --> | recorder |
+template<typename Channel>
+void checkAsyncBoundary(unsigned senders)
+{
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    constexpr auto messages_per_sender = 500u;
+
+    vector<string> traces;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+    Conduit tcp_protocol{ Protocol{ TCPProtocol{} } };
+    tcp_protocol.setSideB( recorder );
+    Channel channel{ tcp_protocol };
+    Conduit boundary{ Protocol{ AsyncBoundary<Channel>{ channel } } };
+
+    auto send = [ & ](unsigned sender)
+    {
+        for(auto i = 0u; i < messages_per_sender; ++i) {
+            // The message is gone as soon as accept returns.
+            Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+            msg.append( to_string( sender ) + ":" + to_string( i ) );
+            boundary.accept( InformationChunk<Message>{ msg } );
+        }
+    };
+    vector<thread> threads;
+    for(auto s = 0u; s < senders; ++s) threads.emplace_back( send, s );
+    for(auto& t : threads) t.join();
+    channel.flush();
+
+    EXPECT_EQ( channel.delivered(), senders * messages_per_sender );
+    ASSERT_EQ( traces.size(), senders * messages_per_sender );
+
+    // Messages of every sender come out in order, having gone through the protocol.
+    vector<unsigned> next( senders );
+    for(auto& trace : traces) {
+        auto begin = trace.find( "-----------\n" ) + 12;
+        auto colon = trace.find( ':', begin );
+        auto sender = stoul( trace.substr( begin, colon - begin ) );
+        EXPECT_EQ( stoul( trace.substr( colon + 1 ) ), next[ sender ]++ );
+        EXPECT_NE( trace.find( "TCPProtocol" ), string::npos );
+    }
+}
+
+}
+
+TEST(ConduitTest, AsyncBoundaries) {
+
+    using mock_conduits::Message;
+
+    checkAsyncBoundary<reconduits::SpscChannel<Message>>( 1 );
+    checkAsyncBoundary<reconduits::MpscChannel<Message>>( 4 );
+}
+
+TEST(ConduitTest, AsyncBoundariesDropOrigins) {
+
+    // | boundary | ~~> | recorder |
+    // Conduits behind a boundary run on another thread, so they do not get
+    // to see the conduits in front of it.
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    vector<string> traces;
+    vector<Conduit*> origins;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces, nullptr, &origins } } };
+    SpscChannel<Message> channel{ recorder };
+    Conduit boundary{ Protocol{ AsyncBoundary<SpscChannel<Message>>{ channel } } };
+
+    Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+    boundary.accept( reconduits::Setup<Message>{ msg, &boundary } );
+    boundary.accept( InformationChunk<Message>{ msg } );
+    boundary.accept( Release<Message>{ msg, &boundary } );
+    channel.flush();
+
+    EXPECT_EQ( traces.size(), 3u );
+    EXPECT_EQ( origins, ( vector<Conduit*>{ nullptr, nullptr } ) );
+}
+
+namespace {
+
+struct RecorderGraph
+{
+    RecorderGraph() { tcp_protocol.setSideB( recorder ); }
+
+    reconduits::Conduit& entry() noexcept { return tcp_protocol; }
+
+    std::vector<std::string> traces;
+    reconduits::Conduit recorder{ reconduits::Adapter{ mock_conduits::RecorderAdapter{ &traces } } };
+    reconduits::Conduit tcp_protocol{ reconduits::Protocol{ mock_conduits::TCPProtocol{} } };
+};
+
+}
+
+TEST(ConduitTest, ShardedRuntime) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    constexpr auto shards = 4u;
+    constexpr auto messages = 200u;
+
+    vector<size_t> built;
+    auto runtime = makeShardedRuntime<Message>(shards,
+            [ & ](size_t shard) { built.push_back( shard ); return make_unique<RecorderGraph>(); },
+            MessageFlowHash{});
+    ASSERT_EQ( runtime->size(), shards );
+    EXPECT_EQ( built, ( vector<size_t>{ 0, 1, 2, 3 } ) );
+
+    const Packet* flows[] = { &tcp_http_packets[0], &tcp_http_packets[1], &tcp_tls_packets[0], &tcp_tls_packets[1] };
+    for(auto i = 0u; i < messages; ++i) {
+        auto flow = i % 4;
+        Message msg{chrono::system_clock::now(), *flows[ flow ], uplinks[ flow % 2 ]};
+        msg.append( to_string( flow / 2 ) + ":" + to_string( i ) );
+        runtime->accept( InformationChunk<Message>{ msg } );
+    }
+    runtime->flush();
+
+    // Both directions of a flow meet the same replica, in order.
+    auto total = size_t{};
+    for(auto s = 0u; s < shards; ++s) {
+        auto& traces = runtime->graph( s ).traces;
+        EXPECT_EQ( runtime->delivered( s ), traces.size() );
+        total += traces.size();
+        int last[ 2 ] = { -1, -1 };
+        for(auto& trace : traces) {
+            auto begin = trace.find( "-----------\n" ) + 12;
+            auto colon = trace.find( ':', begin );
+            auto flow = stoul( trace.substr( begin, colon - begin ) );
+            auto i = stoi( trace.substr( colon + 1 ) );
+            EXPECT_LT( last[ flow ], i );
+            last[ flow ] = i;
+        }
+    }
+    EXPECT_EQ( total, messages );
+    for(auto i = 0u; i < 4; ++i) {
+        Message msg{chrono::system_clock::now(), *flows[ i ], uplinks[ i % 2 ]};
+        Message peer{chrono::system_clock::now(), *flows[ i ^ 1 ], uplinks[ ( i ^ 1 ) % 2 ]};
+        EXPECT_EQ( runtime->shardOf( msg ), runtime->shardOf( peer ) );
+    }
+}
+
+TEST(ConduitTest, WorkStealingStrands) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    constexpr auto senders = 2u;
+    constexpr auto messages_per_sender = 1000u;
+    using Strands = FlowStrands<Message, MessageFlowHash>;
+
+    vector<string> traces;
+    mutex traces_mutex;
+    WorkStealingExecutor executor{ 3 };
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces, &traces_mutex } } };
+    Conduit tcp_protocol{ Protocol{ TCPProtocol{} } };
+    tcp_protocol.setSideB( recorder );
+    Strands strands{ executor, tcp_protocol };
+    Conduit boundary{ Protocol{ AsyncBoundary<Strands>{ strands } } };
+
+    // Every sender feeds flows of its own, so their messages are ordered.
+    const Packet* flows[] = { &tcp_http_packets[0], &tcp_tls_packets[0] };
+    auto send = [ & ](unsigned sender)
+    {
+        for(auto i = 0u; i < messages_per_sender; ++i) {
+            Message msg{chrono::system_clock::now(), *flows[ sender ], uplinks[ 0 ]};
+            msg.append( to_string( sender ) + ":" + to_string( i ) );
+            boundary.accept( InformationChunk<Message>{ msg } );
+        }
+    };
+    vector<thread> threads;
+    for(auto s = 0u; s < senders; ++s) threads.emplace_back( send, s );
+    for(auto& t : threads) t.join();
+    strands.flush();
+
+    EXPECT_EQ( strands.delivered(), senders * messages_per_sender );
+    ASSERT_EQ( traces.size(), senders * messages_per_sender );
+    vector<unsigned> next( senders );
+    for(auto& trace : traces) {
+        auto begin = trace.find( "-----------\n" ) + 12;
+        auto colon = trace.find( ':', begin );
+        auto sender = stoul( trace.substr( begin, colon - begin ) );
+        EXPECT_EQ( stoul( trace.substr( colon + 1 ) ), next[ sender ]++ );
+        EXPECT_NE( trace.find( "TCPProtocol" ), string::npos );
+    }
+}
+
+TEST(ConduitTest, ChaseLevDeque) {
+
+    using namespace std;
+    using namespace reconduits;
+
+    constexpr auto items = 100000u;
+
+    ChaseLevDeque<unsigned, 1024> deque;
+    unsigned item{};
+    EXPECT_FALSE( deque.pop( item ) );
+    EXPECT_FALSE( deque.steal( item ) );
+
+    // Every item is taken once, either by its owner or by a thief.
+    vector<unsigned> owner_taken, thief_taken;
+    atomic<bool> done{};
+    thread thief{ [ & ] {
+        unsigned stolen{};
+        while( ! done.load() ) if( deque.steal( stolen ) ) thief_taken.push_back( stolen );
+        while( deque.steal( stolen ) ) thief_taken.push_back( stolen );
+    } };
+    for(auto i = 0u; i < items; ) {
+        auto pushed = deque.push( i );
+        if( pushed ) ++i;
+        if( ( ! pushed || i % 3 == 0 ) && deque.pop( item ) ) owner_taken.push_back( item );
+    }
+    while( deque.pop( item ) ) owner_taken.push_back( item );
+    done.store( true );
+    thief.join();
+
+    ASSERT_EQ( owner_taken.size() + thief_taken.size(), items );
+    vector<bool> seen( items );
+    for(auto i : owner_taken) seen[ i ] = true;
+    for(auto i : thief_taken) {
+        EXPECT_FALSE( seen[ i ] );
+        seen[ i ] = true;
+    }
+}
+
+namespace {
+
+// Counts its runs, and the ones made from within another task.
+struct CountedTask : reconduits::WorkTask
+{
+    static void run(reconduits::WorkTask* task)
+    {
+        auto& counted = *static_cast<CountedTask*>( task );
+        if( running() ) counted.nested_->fetch_add( 1 );
+        running() = true;
+        counted.runs_->fetch_add( 1 );
+        running() = false;
+    }
+
+    static bool& running() noexcept
+    {
+        thread_local bool running{};
+        return running;
+    }
+
+    std::atomic<unsigned>* runs_;
+    std::atomic<unsigned>* nested_;
+};
+
+}
+
+TEST(ConduitTest, WorkStealingOverfilledDeque) {
+
+    using namespace std;
+    using namespace reconduits;
+
+    // Far more than the deque and the injection ring of a single worker hold.
+    constexpr auto tasks = 20000u;
+
+    atomic<unsigned> runs{}, nested{}, strand_runs{};
+    vector<CountedTask> counted( tasks ), posted( tasks );
+    for(auto& t : counted) t.run_ = &CountedTask::run, t.runs_ = &runs, t.nested_ = &nested;
+    for(auto& t : posted) t.run_ = &CountedTask::run, t.runs_ = &strand_runs, t.nested_ = &nested;
+    Strand strand;
+
+    struct Root : WorkTask
+    {
+        vector<CountedTask>* counted_;
+        vector<CountedTask>* posted_;
+        Strand* strand_;
+        WorkStealingExecutor* executor_;
+    };
+    {
+        WorkStealingExecutor executor{ 1 };
+        strand.bind( executor );
+        Root root{ { [](WorkTask* task)
+        {
+            auto& root = *static_cast<Root*>( task );
+            CountedTask::running() = true;
+            for(auto& t : *root.counted_) root.executor_->schedule( &t );
+            for(auto& t : *root.posted_) root.strand_->post( &t );
+            CountedTask::running() = false;
+        } }, &counted, &posted, &strand, &executor };
+        executor.schedule( &root );
+    }
+
+    // Every task ran, none of them in place of a schedule() or a strand.
+    EXPECT_EQ( runs.load(), tasks );
+    EXPECT_EQ( strand_runs.load(), tasks );
+    EXPECT_EQ( nested.load(), 0u );
+    EXPECT_TRUE( strand.idle() );
+}
+
+#ifdef __cpp_impl_coroutine
+TEST(ConduitTest, CoroutineProtocols) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    vector<string> traces;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+    Conduit hello_parser{ Protocol{ CoroutineProtocol<TLSHelloParser>{} } };
+    hello_parser.setSideB( recorder );
+
+    auto send = [ & ](const string& text)
+    {
+        Message msg{chrono::system_clock::now(), tcp_tls_packets[0], uplinks[0]};
+        msg.append( text );
+        hello_parser.accept( InformationChunk<Message>{ msg } );
+    };
+
+    // The first segment is held back and goes on ahead of the second one,
+    // which completes the ClientHello. What comes after the parser is done
+    // just goes through.
+    send( "segment 1" );
+    EXPECT_TRUE( traces.empty() );
+    send( "segment 2" );
+    ASSERT_EQ( traces.size(), 2u );
+    EXPECT_NE( traces[0].find( "segment 1\nTLSHelloParser waits for more" ), string::npos );
+    EXPECT_NE( traces[1].find( "segment 2\nTLSHelloParser has a ClientHello" ), string::npos );
+    send( "segment 3" );
+    ASSERT_EQ( traces.size(), 3u );
+    EXPECT_EQ( traces[2].find( "TLSHelloParser" ), string::npos );
+
+    Message msg{chrono::system_clock::now(), tcp_tls_packets[0], uplinks[0]};
+    hello_parser.accept( Release<Message>{ msg, &hello_parser } );
+    EXPECT_EQ( traces.size(), 4u );
+}
+#endif
+
+TEST(ConduitTest, CreditGates) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    vector<string> traces, alerts, spilled;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+    Conduit upstream{ Adapter{ RecorderAdapter{ &alerts } } };
+    Conduit spill{ Adapter{ RecorderAdapter{ &spilled } } };
+
+    auto send = [](Conduit& gate, const string& text)
+    {
+        Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+        msg.append( text );
+        gate.accept( InformationChunk<Message>{ msg } );
+    };
+    auto connect = [ & ](Conduit& gate)
+    {
+        gate.setSideA( upstream );
+        gate.setSideB( recorder );
+    };
+    auto reset = [ & ] { traces.clear(); alerts.clear(); spilled.clear(); };
+
+    // Upstream hears once about running out of credits, until they come back.
+    {
+        CreditEdge edge{ 2 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge, BackpressurePolicy::drop_newest } } };
+        connect( gate );
+        for(auto i = 0; i < 4; ++i) send( gate, "m" + to_string( i ) );
+        edge.grant();
+        send( gate, "m4" );
+        auto stats = edge.stats();
+        EXPECT_EQ( traces.size(), 3u );
+        EXPECT_EQ( alerts.size(), 1u );
+        EXPECT_NE( alerts[0].find( "m2" ), string::npos );
+        EXPECT_EQ( stats.forwarded, 3u );
+        EXPECT_EQ( stats.dropped, 2u );
+        EXPECT_EQ( stats.granted, 1u );
+        EXPECT_EQ( stats.alerts, 1u );
+        EXPECT_EQ( stats.credits, 0u );
+    }
+    reset();
+
+    // Held chunks go first once credits are back, the oldest ones being dropped.
+    {
+        CreditEdge edge{ 0 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge, BackpressurePolicy::drop_oldest, 2 } } };
+        connect( gate );
+        for(auto i = 0; i < 3; ++i) send( gate, "m" + to_string( i ) );
+        EXPECT_TRUE( traces.empty() );
+        edge.grant( 3 );
+        send( gate, "m3" );
+        ASSERT_EQ( traces.size(), 3u );
+        EXPECT_NE( traces[0].find( "m1" ), string::npos );
+        EXPECT_NE( traces[1].find( "m2" ), string::npos );
+        EXPECT_NE( traces[2].find( "m3" ), string::npos );
+        EXPECT_EQ( edge.stats().dropped, 1u );
+        EXPECT_EQ( edge.stats().forwarded, 3u );
+    }
+    reset();
+
+    // Traffic stops while chunks are held: credits given back by another
+    // thread send them on ahead of the next message, from the thread feeding
+    // the gate. Chunks coming back to the gate meanwhile take credits too.
+    {
+        CreditEdge edge{ 0 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge, BackpressurePolicy::drop_oldest, 4 } } };
+        Conduit credits{ Protocol{ CreditReturn{ edge } } };
+        gate.setSideA( upstream );
+        gate.setSideB( credits );
+        credits.setSideB( recorder );
+        for(auto i = 0; i < 3; ++i) send( gate, "m" + to_string( i ) );
+        EXPECT_TRUE( traces.empty() );
+        thread granter{ [ & ] { edge.grant( 2 ); } };
+        granter.join();
+        EXPECT_TRUE( traces.empty() );
+        Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+        msg.append( "release" );
+        gate.accept( Release<Message>{ msg, &upstream } );
+        ASSERT_EQ( traces.size(), 4u );
+        EXPECT_NE( traces[0].find( "m0" ), string::npos );
+        EXPECT_NE( traces[2].find( "m2" ), string::npos );
+        EXPECT_NE( traces[3].find( "release" ), string::npos );
+        EXPECT_EQ( edge.stats().forwarded, 3u );
+        EXPECT_EQ( edge.stats().credits, 2u );
+    }
+    reset();
+
+    // Held chunks move along with their gate.
+    {
+        CreditEdge edge{ 0 };
+        CreditGate<Message> held{ edge, BackpressurePolicy::drop_oldest, 4 };
+        Message msg{chrono::system_clock::now(), tcp_http_packets[0], uplinks[0]};
+        msg.append( "m0" );
+        held.accept( InformationChunk<Message>{ msg }, &upstream );
+        EXPECT_EQ( held.held(), 1u );
+        Conduit gate{ Protocol{ std::move( held ) } };
+        connect( gate );
+        EXPECT_EQ( held.held(), 0u );
+        edge.grant( 2 );
+        send( gate, "m1" );
+        ASSERT_EQ( traces.size(), 2u );
+        EXPECT_NE( traces[0].find( "m0" ), string::npos );
+        EXPECT_NE( traces[1].find( "m1" ), string::npos );
+    }
+    reset();
+
+    {
+        CreditEdge edge{ 1 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge, spill } } };
+        connect( gate );
+        send( gate, "m0" );
+        send( gate, "m1" );
+        EXPECT_EQ( traces.size(), 1u );
+        ASSERT_EQ( spilled.size(), 1u );
+        EXPECT_NE( spilled[0].find( "m1" ), string::npos );
+        EXPECT_EQ( edge.stats().spilled, 1u );
+    }
+    reset();
+
+    {
+        CreditEdge edge{ 0 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge } } };
+        connect( gate );
+        thread granter{ [ & ] { this_thread::sleep_for( chrono::milliseconds{ 10 } ); edge.grant(); } };
+        send( gate, "m0" );
+        granter.join();
+        EXPECT_EQ( traces.size(), 1u );
+        EXPECT_TRUE( alerts.empty() );
+        EXPECT_EQ( edge.stats().blocked, 1u );
+    }
+    reset();
+
+    // Conduits behind give credits back as chunks get through.
+    {
+        CreditEdge edge{ 1 };
+        Conduit gate{ Protocol{ CreditGate<Message>{ edge, BackpressurePolicy::drop_newest } } };
+        Conduit credits{ Protocol{ CreditReturn{ edge } } };
+        gate.setSideA( upstream );
+        gate.setSideB( credits );
+        credits.setSideB( recorder );
+        for(auto i = 0; i < 8; ++i) send( gate, "m" + to_string( i ) );
+        EXPECT_EQ( traces.size(), 8u );
+        EXPECT_EQ( edge.stats().dropped, 0u );
+        EXPECT_EQ( edge.stats().credits, 1u );
+    }
+}
+
+TEST(ConduitTest, FlowAging) {
+
+    using namespace std;
+    using namespace std::chrono_literals;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | l4_mux [b0] | --> |[a] connection_factory [b]| --> | recorder |
+    L4Mux::aging_type aging{ 5min, L4Mux::aging_type::max_sweep };
+    aging.idleTimeout( Message::http_app_protocol, 1min );
+    EXPECT_EQ( aging.idleTimeout( Message::http_app_protocol ), 1min );
+    EXPECT_EQ( aging.idleTimeout( Message::tls_app_protocol ), 5min );
+
+    vector<string> traces;
+    Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+    Conduit l4_mux{ Mux{ L4Mux{ aging } } };
+    Conduit connection_factory{ Factory{ TCPConnectionFactory{} } };
+    l4_mux.setSideB( connection_factory );
+    connection_factory.setSideA( l4_mux );
+    connection_factory.setSideB( recorder );
+
+    auto send = [ & ](const Packet& packet, bool uplink, chrono::system_clock::time_point tp)
+    {
+        Message msg{tp, packet, uplink};
+        l4_mux.accept( InformationChunk<Message>{ msg } );
+    };
+    auto released = [ & ](const string& connection)
+    {
+        return count_if( traces.begin(), traces.end(), [ & ](auto& trace) { return trace.find( "Release " + connection ) != string::npos; } );
+    };
+
+    auto t0 = chrono::system_clock::now();
+    send( tcp_http_packets[0], uplinks[0], t0 );
+    send( tcp_tls_packets[0], uplinks[0], t0 );
+    EXPECT_EQ( traces.size(), 2u );
+
+    // HTTP has been idle for too long, TLS has not.
+    send( tcp_tls_packets[1], uplinks[1], t0 + 2min );
+    EXPECT_EQ( released( "HTTP" ), 1 );
+    EXPECT_EQ( released( "TLS" ), 0 );
+
+    send( tcp_tls_packets[2], uplinks[2], t0 + 10min );
+    EXPECT_EQ( released( "HTTP" ), 1 );
+    EXPECT_EQ( released( "TLS" ), 1 );
+
+    // A flow coming back after being released starts over.
+    send( tcp_http_packets[0], uplinks[0], t0 + 10min );
+    EXPECT_EQ( released( "HTTP" ), 1 );
+    EXPECT_EQ( traces.size(), 7u );
+
+    // Flows expire with their own protocol, whichever message goes by.
+    L4Mux mux{ aging };
+    Message tcp{t0, tcp_http_packets[0], uplinks[0]};
+    mux.accept( InformationChunk<Message>{ tcp }, nullptr, mux.table().find( mux.routeKey( InformationChunk<Message>{ tcp } ) ) );
+    Message udp{t0 + 10min, Packet{ IPv4Header{ "10.1.1.1", "10.2.2.2", ProtocolType::udp }, UDPHeader{ 5353, 53 } }, true};
+    vector<ProtocolType> expired;
+    mux.expire( InformationChunk<Message>{ udp }, [ & ](Message& m) { expired.push_back( m.packet().get_proto() ); } );
+    EXPECT_EQ( expired, vector<ProtocolType>{ ProtocolType::tcp } );
+}
+
+TEST(ConduitTest, BatchLookupsMatchSingleLookups) {
+
+    using namespace std;
+    using namespace reconduits;
+    using namespace mock_conduits;
+
+    // | l4_mux [b0] | --> |[a] connection_factory [b]| --> | recorder |
+    struct L4Graph
+    {
+        L4Graph()
+        {
+            l4_mux.setSideB( connection_factory );
+            connection_factory.setSideA( l4_mux );
+            connection_factory.setSideB( recorder );
+        }
+
+        vector<string> traces;
+        Conduit recorder{ Adapter{ RecorderAdapter{ &traces } } };
+        Conduit l4_mux{ Mux{ L4Mux{} } };
+        Conduit connection_factory{ Factory{ TCPConnectionFactory{} } };
+    };
+
+    L4Graph one_by_one_graph;
+    L4Graph batch_graph;
+
+    // Flows created, established and closed within the batch make the
+    // lookups made ahead stale.
+    MonotonicArena message_arena;
+    vector<Message> one_by_one;
+    vector<Message> in_batch;
+    auto now = chrono::system_clock::now();
+    for(auto i = 0u; i < sizeof tcp_http_packets / sizeof tcp_http_packets[0]; ++i) {
+        for( auto& packet : { tcp_http_packets[i], tcp_tls_packets[i] } ) {
+            one_by_one.emplace_back(now, packet, uplinks[i], &message_arena);
+            in_batch.emplace_back(now, packet, uplinks[i], &message_arena);
+        }
+    }
+
+    for( auto& msg : one_by_one ) one_by_one_graph.l4_mux.accept( InformationChunk<Message>{ msg } );
+    vector<Message*> items;
+    for( auto& msg : in_batch ) items.push_back( &msg );
+    batch_graph.l4_mux.accept( Batch<Message>{ items.data(), items.size() } );
+
+    EXPECT_GT( items.size(), mux_lookup_group );
+    ASSERT_EQ( one_by_one_graph.traces.size(), batch_graph.traces.size() );
+    for(auto i = 0u; i < one_by_one.size(); ++i) {
+        ostringstream expected, actual;
+        expected << one_by_one[i];
+        actual << in_batch[i];
+        EXPECT_EQ( expected.str(), actual.str() ) << "message " << i;
+    }
+}
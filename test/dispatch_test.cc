@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+
+#include "ReConduitVisitors.hpp"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace {
+
+template<int N>
+struct Kind
+{
+    static constexpr int id = N;
+    int value_;
+};
+
+template<int N>
+struct Chunk
+{
+    static constexpr int id = N;
+    int value_;
+};
+
+// 3 x 6 pairs, more than fit in one switch of the switch back-end.
+using kind_type  = std::variant<Kind<0>*, Kind<1>*, Kind<2>*>;
+using chunk_type = std::variant<Chunk<0>, Chunk<1>, Chunk<2>, Chunk<3>, Chunk<4>, Chunk<5>>;
+
+template<typename V, std::size_t... I>
+V alternative(std::size_t i, std::index_sequence<I...>, auto&& make)
+{
+    V v{};
+    ( ( i == I ? void( v = make( std::integral_constant<std::size_t, I>{} ) ) : void() ), ... );
+    return v;
+}
+
+}
+
+//////////////////////////////////////
+// Tests
+//////////////////////////////////////
+
+TEST(DispatchTest, BackEndsMatchVisit) {
+
+    using namespace reconduits;
+
+    Kind<0> k0{ 100 };
+    Kind<1> k1{ 200 };
+    Kind<2> k2{ 300 };
+    auto kinds = std::make_tuple( &k0, &k1, &k2 );
+
+    auto f = [](auto&& kind_ptr, auto&& chunk)
+    {
+        using K = std::decay_t<decltype(*kind_ptr)>;
+        using C = std::decay_t<decltype(chunk)>;
+        return std::pair{ K::id * 10 + C::id, kind_ptr->value_ + chunk.value_ };
+    };
+
+    for( auto k = std::size_t{}; k < std::variant_size_v<kind_type>; ++k ) {
+        for( auto c = std::size_t{}; c < std::variant_size_v<chunk_type>; ++c ) {
+            auto v = alternative<kind_type>(k, std::make_index_sequence<3>{}, [ & ](auto index)
+            {
+                return kind_type{ std::in_place_index<index>, std::get<index>( kinds ) };
+            });
+            auto m = alternative<chunk_type>(c, std::make_index_sequence<6>{}, [ & ](auto index)
+            {
+                return chunk_type{ std::in_place_index<index>, std::variant_alternative_t<index, chunk_type>{ static_cast<int>( c ) } };
+            });
+
+            auto expected = visitDoubleDispatch_r(v, m, f);
+            EXPECT_EQ( expected, std::pair( static_cast<int>( k * 10 + c ), static_cast<int>( ( k + 1 ) * 100 + c ) ) );
+            EXPECT_EQ( tableDoubleDispatch_r(v, m, f), expected ) << k << ", " << c;
+            EXPECT_EQ( switchDoubleDispatch_r(v, m, f), expected ) << k << ", " << c;
+        }
+    }
+}
@@ -0,0 +1,245 @@
+#include "gtest/gtest.h"
+
+#include "FlatFlowTable.hpp"
+#include "FlowAging.hpp"
+
+#include <unordered_map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+namespace {
+
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+// Only 8 distinct values, so that long probe runs and wrapping are common.
+struct CollidingHash
+{
+    std::size_t operator()(std::uint32_t k) const noexcept { return k % 8; }
+};
+
+template<typename Table>
+void checkAgainstUnorderedMap()
+{
+    std::mt19937 random{ 42 };
+    Table table;
+    std::unordered_map<std::uint32_t, std::string> reference;
+
+    for( auto i = 0; i < 20000; ++i ) {
+        auto key = static_cast<std::uint32_t>( random() % 512 );
+        if( random() % 3 ) {
+            auto [ value, inserted ] = table.try_emplace( key, std::to_string( key ) );
+            EXPECT_EQ( inserted, reference.emplace( key, std::to_string( key ) ).second );
+            EXPECT_EQ( *value, std::to_string( key ) );
+        } else {
+            EXPECT_EQ( table.erase( key ), reference.erase( key ) == 1 );
+        }
+        // Lookups are checked while rehashing too.
+        if( i % 7 == 0 ) {
+            ASSERT_EQ( table.find( key ) != nullptr, reference.count( key ) == 1 );
+        }
+    }
+
+    ASSERT_EQ( table.size(), reference.size() );
+    EXPECT_LE( table.size() * 8, table.capacity() * 7 );
+    for( auto key = 0u; key < 512; ++key ) {
+        auto value = std::as_const( table ).find( key );
+        auto it = reference.find( key );
+        ASSERT_EQ( value != nullptr, it != reference.end() );
+        if( value ) {
+            EXPECT_EQ( *value, it->second );
+        }
+    }
+    auto visited = std::size_t{};
+    table.forEach( [ & ](auto key, auto& value) { ++visited; EXPECT_EQ( value, std::to_string( key ) ); } );
+    EXPECT_EQ( visited, reference.size() );
+
+    table.clear();
+    EXPECT_TRUE( table.empty() );
+    EXPECT_EQ( table.find( 1 ), nullptr );
+}
+
+}
+
+//////////////////////////////////////
+// Tests
+//////////////////////////////////////
+
+TEST(FlowTableTest, FindInsertErase) {
+
+    using namespace reconduits;
+
+    FlatFlowTable<flow_key, int> table;
+    EXPECT_TRUE( table.empty() );
+    EXPECT_EQ( table.find( flow_key{ 1, 2, 3, 4 } ), nullptr );
+
+    auto [ value, inserted ] = table.try_emplace( flow_key{ 1, 2, 3, 4 }, 7 );
+    ASSERT_TRUE( inserted );
+    EXPECT_EQ( *value, 7 );
+    EXPECT_FALSE( table.try_emplace( flow_key{ 1, 2, 3, 4 }, 8 ).second );
+
+    // The reverse direction is another flow.
+    EXPECT_EQ( table.find( flow_key{ 2, 1, 4, 3 } ), nullptr );
+    table.try_emplace( flow_key{ 2, 1, 4, 3 }, 9 );
+    EXPECT_EQ( *table.find( flow_key{ 1, 2, 3, 4 } ), 7 );
+    EXPECT_EQ( *table.find( flow_key{ 2, 1, 4, 3 } ), 9 );
+    EXPECT_EQ( table.size(), 2u );
+
+    EXPECT_TRUE( table.erase( flow_key{ 1, 2, 3, 4 } ) );
+    EXPECT_FALSE( table.erase( flow_key{ 1, 2, 3, 4 } ) );
+    EXPECT_EQ( table.find( flow_key{ 1, 2, 3, 4 } ), nullptr );
+    EXPECT_EQ( *table.find( flow_key{ 2, 1, 4, 3 } ), 9 );
+
+    FlatFlowTable<flow_key, int> moved{ std::move( table ) };
+    EXPECT_TRUE( table.empty() );
+    EXPECT_EQ( *moved.find( flow_key{ 2, 1, 4, 3 } ), 9 );
+}
+
+TEST(FlowTableTest, MatchesUnorderedMap) {
+
+    using namespace reconduits;
+
+    checkAgainstUnorderedMap<FlatFlowTable<std::uint32_t, std::string, CollidingHash>>();
+    checkAgainstUnorderedMap<FlatFlowTable<std::uint32_t, std::string>>();
+    checkAgainstUnorderedMap<FlatFlowTable<std::uint32_t, std::string, CollidingHash, std::equal_to<std::uint32_t>, IncrementalRehash<1>>>();
+    checkAgainstUnorderedMap<FlatFlowTable<std::uint32_t, std::string, FlowHash<std::uint32_t>, std::equal_to<std::uint32_t>, IncrementalRehash<4>>>();
+}
+
+TEST(FlowTableTest, IncrementalRehash) {
+
+    using namespace reconduits;
+
+    FlatFlowTable<std::uint64_t, std::uint64_t, FlowHash<std::uint64_t>, std::equal_to<std::uint64_t>, IncrementalRehash<8>> table;
+    auto rehashed = 0u;
+    for( auto i = std::uint64_t{}; i < 100000; ++i ) {
+        auto capacity = table.capacity();
+        table.try_emplace( i, i );
+        if( table.capacity() != capacity && capacity >= 64 ) {
+            // Old entries are still there while they move across.
+            ++rehashed;
+            EXPECT_TRUE( table.rehashing() );
+            for( auto j = std::uint64_t{}; j <= i; j += 97 ) ASSERT_EQ( *table.find( j ), j );
+        } else if( table.rehashing() && i % 1024 == 0 ) {
+            // Including once the pages of the slots moved are given back.
+            for( auto j = std::uint64_t{}; j <= i; j += 97 ) ASSERT_EQ( *table.find( j ), j );
+        }
+    }
+    EXPECT_GT( rehashed, 8u );
+    for( auto i = std::uint64_t{}; i < 100000; i += 2 ) ASSERT_TRUE( table.erase( i ) );
+    EXPECT_FALSE( table.rehashing() );
+    EXPECT_EQ( table.size(), 50000u );
+    for( auto i = std::uint64_t{}; i < 100000; ++i ) ASSERT_EQ( table.find( i ) != nullptr, i % 2 == 1 );
+}
+
+TEST(FlowTableTest, ReserveAvoidsGrowth) {
+
+    using namespace reconduits;
+
+    FlatFlowTable<std::uint64_t, std::uint64_t> table;
+    table.reserve( 1000 );
+    auto capacity = table.capacity();
+    EXPECT_GE( capacity * 7, 1000u * 8 );
+    for( auto i = std::uint64_t{}; i < 1000; ++i ) table.try_emplace( i, i );
+    EXPECT_EQ( table.capacity(), capacity );
+    for( auto i = std::uint64_t{}; i < 1000; ++i ) ASSERT_EQ( *table.find( i ), i );
+}
+
+TEST(FlowTableTest, SweepGoesRound) {
+
+    using namespace reconduits;
+
+    FlatFlowTable<std::uint64_t, int> table;
+    for( auto i = std::uint64_t{}; i < 10; ++i ) table.try_emplace( i, 0 );
+
+    // Every entry is visited once per turn of the hand, a few slots at a time.
+    for( auto turn = 1; turn <= 2; ++turn ) {
+        for( auto slots = std::size_t{}; slots < table.capacity(); slots += 3 ) {
+            table.sweep( 3, [](auto, auto& visits) { ++visits; } );
+        }
+        table.forEach( [ & ](auto, auto& visits) { EXPECT_GE( visits, turn ); EXPECT_LE( visits, turn + 1 ); } );
+    }
+}
+
+TEST(FlowTableTest, FlowAging) {
+
+    using namespace reconduits;
+    using namespace std::chrono_literals;
+    using clock = std::chrono::steady_clock;
+
+    struct Flow
+    {
+        FlowAge<clock> age_;
+    };
+
+    FlowAging<clock> aging{ 10s, 4 };
+    aging.idleTimeout( 17, 1s );
+    EXPECT_EQ( aging.idleTimeout( 17 ), 1s );
+    EXPECT_EQ( aging.idleTimeout( 6 ), 10s );
+
+    FlatFlowTable<std::uint64_t, Flow> table;
+    auto t0 = clock::time_point{};
+    for( auto i = std::uint64_t{}; i < 100; ++i ) table.try_emplace( i, aging.age( i % 2 ? 17 : 6, t0 ) );
+    table.find( 1 )->age_.touch( t0 + 5s );
+    table.find( 1 )->age_.touch( t0 + 4s );
+
+    // Expired flows may be erased as they are handed over.
+    auto evicted = std::size_t{};
+    for( auto slots = std::size_t{}; slots < table.capacity(); slots += aging.sweepSize() ) {
+        evicted += aging.sweep( table, t0 + 2s, [ & ](auto key) { EXPECT_TRUE( table.erase( key ) ); } );
+    }
+    // Backward shifts may move an entry behind the hand for a turn.
+    for( auto slots = std::size_t{}; slots < table.capacity(); slots += aging.sweepSize() ) {
+        evicted += aging.sweep( table, t0 + 2s, [ & ](auto key) { EXPECT_TRUE( table.erase( key ) ); } );
+    }
+    EXPECT_EQ( evicted, 49u );
+    EXPECT_EQ( table.size(), 51u );
+    EXPECT_NE( table.find( 1 ), nullptr );
+    for( auto i = std::uint64_t{ 3 }; i < 100; i += 2 ) EXPECT_EQ( table.find( i ), nullptr );
+}
+
+TEST(FlowTableTest, FindMany) {
+
+    using namespace reconduits;
+
+    FlatFlowTable<std::uint64_t, std::uint64_t, FlowHash<std::uint64_t>, std::equal_to<std::uint64_t>, IncrementalRehash<1>> table;
+    for( auto i = std::uint64_t{}; i < 1000; i += 2 ) table.try_emplace( i, i );
+
+    // Across group boundaries, hits and misses, while rehashing or not.
+    std::vector<std::uint64_t> keys;
+    for( auto i = std::uint64_t{}; i < 100; ++i ) keys.push_back( i * 7 );
+    std::vector<std::uint64_t*> found( keys.size() );
+    for( auto round = 0; round < 2; ++round ) {
+        auto version = table.version();
+        table.find_many( keys.data(), keys.size(), found.data() );
+        for( auto i = std::size_t{}; i < keys.size(); ++i ) {
+            if( keys[ i ] % 2 ) {
+                EXPECT_EQ( found[ i ], nullptr );
+            } else {
+                ASSERT_NE( found[ i ], nullptr );
+                EXPECT_EQ( *found[ i ], keys[ i ] );
+            }
+        }
+        EXPECT_EQ( table.rehashing(), round == 0 );
+        EXPECT_EQ( table.version() != version, round == 0 );
+        table.reserve( 0 );
+    }
+
+    // Inserting without growing moves nothing, so entries found before stay
+    // good. Erasing may move them.
+    auto version = table.version();
+    auto capacity = table.capacity();
+    table.find_many( keys.data(), keys.size(), found.data() );
+    table.try_emplace( 1, std::uint64_t{ 1 } );
+    ASSERT_EQ( table.capacity(), capacity );
+    EXPECT_EQ( table.version(), version );
+    for( auto i = std::size_t{}; i < keys.size(); ++i ) {
+        if( keys[ i ] % 2 == 0 ) {
+            EXPECT_EQ( found[ i ], table.find( keys[ i ] ) );
+        }
+    }
+    table.erase( 0 );
+    EXPECT_NE( table.version(), version );
+}
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+
+#include "MessageTypes.hpp"
+#include "MessageArena.hpp"
+
+#include <set>
+#include <type_traits>
+
+//////////////////////////////////////
+// Tests
+//////////////////////////////////////
+
+TEST(MessageTest, ValueMessages) {
+
+    using namespace reconduits;
+
+    static_assert( sizeof(message_type<int>) <= 3 * sizeof(void*) );
+    static_assert( std::is_trivially_copyable_v<message_type<int>> );
+
+    int payload = 0;
+    auto origin = reinterpret_cast<Conduit*>( &payload );
+    InformationChunk<int> chunk{ payload };
+
+    auto v_chunk   = make_variant_message( chunk );
+    auto v_setup   = make_variant_setup_message(chunk, origin);
+    auto v_release = make_variant_release_message(chunk, origin);
+    EXPECT_EQ( &std::get<InformationChunk<int>>( v_chunk ).get(), &payload );
+    EXPECT_EQ( &std::get<reconduits::Setup<int>>( v_setup ).get(), &payload );
+    EXPECT_EQ( std::get<reconduits::Setup<int>>( v_setup ).getOrigin(), origin );
+    EXPECT_EQ( std::get<Release<int>>( v_release ).getOrigin(), origin );
+}
+
+TEST(MessageTest, ArenaScopedStorage) {
+
+    using namespace reconduits;
+
+    struct Slot { void* p_; std::size_t n_; };
+
+    Slot* first = nullptr;
+    {
+        MessageArenaScope outer;
+        first = getMessageArena().make<Slot>();
+
+        std::set<void*> distinct{ first };
+        {
+            // Nested accept calls keep their own storage...
+            MessageArenaScope inner;
+            for( auto i = 0; i < 1000; ++i ) distinct.insert( getMessageArena().make<Slot>() );
+        }
+        // ... and leaving a nested scope does not rewind the arena.
+        distinct.insert( getMessageArena().make<Slot>() );
+        EXPECT_EQ( distinct.size(), 1002u );
+    }
+
+    // The outermost scope rewinds it, so storage is reused without allocating.
+    MessageArenaScope next;
+    EXPECT_EQ( getMessageArena().make<Slot>(), first );
+}
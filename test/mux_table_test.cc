@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+
+#include "MuxTable.hpp"
+
+#include <variant>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+
+namespace {
+
+struct FlowContext
+{
+    reconduits::Conduit* next_conduit_;
+    int packets_;
+};
+
+enum class Protocol : std::uint8_t { icmp = 1, tcp = 6, udp = 17, gre = 47 };
+
+reconduits::Conduit& fakeConduit(std::uintptr_t address) { return *reinterpret_cast<reconduits::Conduit*>( address ); }
+
+}
+
+//////////////////////////////////////
+// Tests
+//////////////////////////////////////
+
+TEST(MuxTableTest, DenseKeys) {
+
+    using namespace reconduits;
+
+    MuxTable<Protocol, Conduit*, FlowHash<Protocol>, DenseKeys<32>> table;
+    auto& tcp = fakeConduit( 0x1000 );
+    auto& udp = fakeConduit( 0x2000 );
+
+    EXPECT_TRUE( table.empty() );
+    EXPECT_EQ( table.find( Protocol::tcp ), nullptr );
+    EXPECT_EQ( table.route( Protocol::tcp, tcp ), &tcp );
+    EXPECT_EQ( table.route( Protocol::udp, udp ), &udp );
+    EXPECT_EQ( *table.find( Protocol::tcp ), &tcp );
+    EXPECT_EQ( table.size(), 2u );
+
+    // Routing again replaces the conduit.
+    EXPECT_EQ( table.route( Protocol::tcp, udp ), &udp );
+    EXPECT_EQ( *table.find( Protocol::tcp ), &udp );
+
+    EXPECT_EQ( table.unroute( Protocol::tcp ), &udp );
+    EXPECT_EQ( table.unroute( Protocol::tcp ), nullptr );
+    EXPECT_EQ( table.find( Protocol::tcp ), nullptr );
+    EXPECT_EQ( table.size(), 1u );
+
+    // Keys out of range are never stored.
+    EXPECT_EQ( table.route( static_cast<Protocol>( 40 ), tcp ), nullptr );
+    EXPECT_EQ( table.find( static_cast<Protocol>( 40 ) ), nullptr );
+}
+
+TEST(MuxTableTest, DirectIndex) {
+
+    using namespace reconduits;
+
+    MuxTable<Protocol, Conduit*, FlowHash<Protocol>, DirectIndex<256>> table;
+    auto& tcp  = fakeConduit( 0x1000 );
+    auto& sink = fakeConduit( 0x2000 );
+
+    EXPECT_EQ( table.find( Protocol::tcp ), nullptr );
+    EXPECT_EQ( table.route( Protocol::tcp, tcp ), &tcp );
+    EXPECT_EQ( table.route( Protocol::icmp, sink ), &sink );
+    EXPECT_EQ( table.route( Protocol::gre, sink ), &sink );
+    EXPECT_EQ( *table.find( Protocol::tcp ), &tcp );
+    EXPECT_EQ( *table.find( Protocol::gre ), &sink );
+    EXPECT_EQ( table.find( Protocol::udp ), nullptr );
+    EXPECT_EQ( table.size(), 3u );
+
+    // Every change is seen by lookups made ahead.
+    auto version = table.version();
+    EXPECT_EQ( table.unroute( Protocol::icmp ), &sink );
+    EXPECT_NE( table.version(), version );
+    EXPECT_EQ( table.find( Protocol::icmp ), nullptr );
+    EXPECT_EQ( table.size(), 2u );
+
+    // Null conduits are never stored.
+    EXPECT_FALSE( table.try_emplace( Protocol::udp, nullptr ).second );
+    EXPECT_EQ( table.find( Protocol::udp ), nullptr );
+
+    table.clear();
+    EXPECT_TRUE( table.empty() );
+    EXPECT_EQ( table.find( Protocol::tcp ), nullptr );
+}
+
+TEST(MuxTableTest, HashedKeysWithFlowState) {
+
+    using namespace reconduits;
+    using key_type = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+    MuxTable<key_type, FlowContext> table;
+    key_type flow{ 1, 2, 55000, 80 };
+    auto& http = fakeConduit( 0x1000 );
+
+    // Routes only go to flows the mux already keeps.
+    EXPECT_EQ( table.route( flow, http ), nullptr );
+    table.try_emplace( flow, nullptr, 1 );
+    EXPECT_EQ( table.route( flow, http ), &http );
+    EXPECT_EQ( table.find( flow )->next_conduit_, &http );
+    EXPECT_EQ( table.find( flow )->packets_, 1 );
+
+    // Factories hand their keys inside variants.
+    using factory_key = std::variant<int, key_type>;
+    EXPECT_EQ( table.unroute( *tableKeyOf<key_type>( factory_key{ flow } ) ), &http );
+    EXPECT_TRUE( table.empty() );
+    EXPECT_FALSE( tableKeyOf<key_type>( factory_key{ 17 } ) );
+}
+
+TEST(MuxTableTest, LongestPrefix) {
+
+    using namespace reconduits;
+
+    MuxTable<std::uint32_t, Conduit*, FlowHash<std::uint32_t>, LongestPrefix> table;
+    auto& any   = fakeConduit( 0x1000 );
+    auto& net10 = fakeConduit( 0x2000 );
+    auto& net24 = fakeConduit( 0x3000 );
+    auto& host  = fakeConduit( 0x4000 );
+
+    table.try_emplace( Prefix<std::uint32_t>{ 0, 0 }, &any );
+    table.try_emplace( Prefix<std::uint32_t>{ 0x0a000000, 8 }, &net10 );
+    table.try_emplace( Prefix<std::uint32_t>{ 0x0a0b0cff, 24 }, &net24 );
+    table.route( 0x0a0b0c0d, host );
+    EXPECT_EQ( table.size(), 4u );
+
+    EXPECT_EQ( *table.find( 0x0a0b0c0d ), &host );
+    EXPECT_EQ( *table.find( 0x0a0b0c0e ), &net24 );
+    EXPECT_EQ( *table.find( 0x0a0b0d0e ), &net10 );
+    EXPECT_EQ( *table.find( 0xc0a80001 ), &any );
+
+    EXPECT_TRUE( table.erase( Prefix<std::uint32_t>{ 0x0a0b0c00, 24 } ) );
+    EXPECT_FALSE( table.erase( Prefix<std::uint32_t>{ 0x0a0b0c00, 24 } ) );
+    EXPECT_EQ( *table.find( 0x0a0b0c0e ), &net10 );
+    EXPECT_EQ( table.unroute( 0x0a0b0c0d ), &host );
+    EXPECT_EQ( *table.find( 0x0a0b0c0d ), &net10 );
+
+    auto lengths = std::vector<int>{};
+    table.forEach( [ & ](auto prefix, auto) { lengths.push_back( prefix.length_ ); } );
+    EXPECT_EQ( lengths, ( std::vector<int>{ 8, 0 } ) );
+
+    table.clear();
+    EXPECT_EQ( table.find( 0x0a0b0c0d ), nullptr );
+}
@@ -0,0 +1,276 @@
+#include "gtest/gtest.h"
+
+#include "ReConduitPool.hpp"
+#include "ReConduitMemoryResource.hpp"
+
+#include <set>
+#include <vector>
+#include <thread>
+
+//////////////////////////////////////
+// Tests
+//////////////////////////////////////
+
+TEST(PoolTest, SlabFreeListReusesBlocks) {
+
+    using namespace reconduits;
+
+    ConduitsPool<40> pool;
+    EXPECT_EQ( pool.capacity(), 0u );
+
+    auto first = pool.get();
+    EXPECT_EQ( pool.capacity(), ConduitsPool<40>::blocks_per_slab );
+    EXPECT_EQ( pool.inUse(), 1u );
+
+    pool.put( first );
+    EXPECT_EQ( pool.inUse(), 0u );
+    EXPECT_EQ( pool.get(), first );
+    pool.put( first );
+}
+
+TEST(PoolTest, SlabGrowsInChunks) {
+
+    using namespace reconduits;
+
+    constexpr auto n = 3 * ConduitsPool<24>::blocks_per_slab + 1;
+
+    ConduitsPool<24> pool{ 8 };
+    EXPECT_EQ( pool.capacity(), ConduitsPool<24>::blocks_per_slab );
+
+    std::vector<void*> blocks;
+    for( auto i = 0u; i < n; ++i ) blocks.push_back( pool.get() );
+
+    std::set<void*> distinct( blocks.cbegin(), blocks.cend() );
+    EXPECT_EQ( distinct.size(), n );
+    EXPECT_EQ( pool.inUse(), n );
+    EXPECT_GE( pool.capacity(), n );
+
+    for( auto b : blocks ) {
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>( b ) % alignof(std::max_align_t), 0u );
+        pool.put( b );
+    }
+    EXPECT_EQ( pool.inUse(), 0u );
+}
+
+TEST(PoolTest, MagazinesAcrossThreads) {
+
+    using namespace reconduits;
+
+    constexpr auto threads = 4u;
+    constexpr auto rounds  = 20000u;
+
+    // Every thread frees the blocks allocated by its neighbour.
+    std::vector<std::vector<void*>> allocated( threads );
+    auto allocate = [ & ](unsigned t) {
+        for( auto i = 0u; i < rounds; ++i ) allocated[t].push_back( getFromPool<72>() );
+    };
+    auto release = [ & ](unsigned t) {
+        for( auto p : allocated[ ( t + 1 ) % threads ] ) putToPool<72>( p );
+    };
+
+    std::vector<std::thread> workers;
+    for( auto t = 0u; t < threads; ++t ) workers.emplace_back( allocate, t );
+    for( auto& w : workers ) w.join();
+    workers.clear();
+
+    std::set<void*> distinct;
+    for( auto& v : allocated ) distinct.insert( v.cbegin(), v.cend() );
+    EXPECT_EQ( distinct.size(), threads * rounds );
+
+    auto capacity = [] { return getPoolInstance<sizeClassOf(72)>().withSlab([](auto&& slab) { return slab.capacity(); }); };
+    auto capacity_before = capacity();
+
+    for( auto t = 0u; t < threads; ++t ) workers.emplace_back( release, t );
+    for( auto& w : workers ) w.join();
+    workers.clear();
+
+    // Released blocks are parked in the depot and served again without growing the slab.
+    for( auto& v : allocated ) v.clear();
+    for( auto t = 0u; t < threads; ++t ) workers.emplace_back( allocate, t );
+    for( auto& w : workers ) w.join();
+    workers.clear();
+    EXPECT_EQ( capacity(), capacity_before );
+
+    for( auto t = 0u; t < threads; ++t ) workers.emplace_back( release, t );
+    for( auto& w : workers ) w.join();
+}
+
+TEST(PoolTest, MagazineStack) {
+
+    using namespace reconduits;
+
+    // Last in, first out, whichever stack the magazines end up in.
+    MagazineStack stack;
+    Magazine first, second;
+    stack.push( &first );
+    stack.push( &second );
+    EXPECT_EQ( stack.pop(), &second );
+    EXPECT_EQ( stack.pop(), &first );
+    EXPECT_EQ( stack.pop(), nullptr );
+
+    // Addresses above 48 bits would lose their top bits to the tag.
+    EXPECT_TRUE( MagazineStack::packable( &first ) );
+    EXPECT_FALSE( MagazineStack::packable( reinterpret_cast<Magazine*>( std::uintptr_t{ 1 } << 56 ) ) );
+}
+
+TEST(PoolTest, SizeClassesHonourAlignment) {
+
+    using namespace reconduits;
+
+    static_assert( sizeClassOf(1) == 16 );
+    static_assert( sizeClassOf(33) == sizeClassOf(48) );
+    static_assert( sizeClassOf(129) == 160 );
+    static_assert( sizeClassOf(257) == 320 );
+    static_assert( sizeClassOf(40, 64) == 64 );
+    static_assert( sizeClassOf(100, 64) == 128 );
+    static_assert( sizeClassOf(200, 64) == 256 );
+
+    struct alignas(64) CacheLineConduit { char state_[ 72 ]; };
+
+    std::vector<void*> blocks;
+    for( auto i = 0u; i < 100; ++i ) {
+        auto p = getFromPool<sizeof(CacheLineConduit), alignof(CacheLineConduit)>();
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>( p ) % 64, 0u );
+        blocks.push_back( p );
+    }
+    for( auto p : blocks ) putToPool<sizeof(CacheLineConduit), alignof(CacheLineConduit)>( p );
+
+    // Families of similar size share their size class.
+    auto p = getFromPool<120>();
+    putToPool<120>( p );
+    EXPECT_EQ( getFromPool<128>(), p );
+    putToPool<128>( p );
+}
+
+TEST(PoolTest, ArenaReservation) {
+
+    using namespace reconduits;
+
+    struct FlowState { char state_[ 200 ]; };
+    using pool_type = ConduitsPool<sizeClassOf(sizeof(FlowState))>;
+
+    auto mapped = getPoolArena().stats().mapped_bytes;
+    getPoolArena().reserve( 4 * PoolArena::huge_page_size );
+    EXPECT_GE( getPoolArena().stats().mapped_bytes, mapped );
+
+    constexpr auto flows = 10000u;
+    reserveFor<FlowState>( flows );
+    auto& depot = getPoolInstance<sizeClassOf(sizeof(FlowState))>();
+    auto capacity = depot.withSlab([](auto&& slab) { return slab.capacity(); });
+    EXPECT_GE( capacity, flows );
+
+    // Reserved blocks are served without growing the pool.
+    std::vector<void*> blocks;
+    for( auto i = 0u; i < flows; ++i ) {
+        auto p = getFromPool<sizeof(FlowState)>();
+        auto slab = reinterpret_cast<std::uintptr_t>( p ) & ~( pool_type::slab_size - 1 );
+        EXPECT_LT( reinterpret_cast<std::uintptr_t>( p ) - slab, pool_type::slab_size );
+        blocks.push_back( p );
+    }
+    EXPECT_EQ( depot.withSlab([](auto&& slab) { return slab.capacity(); }), capacity );
+    for( auto p : blocks ) putToPool<sizeof(FlowState)>( p );
+}
+
+TEST(PoolTest, FreeSlabsAreReclaimed) {
+
+    using namespace reconduits;
+
+    using pool_type = ConduitsPool<256>;
+    pool_type pool{ 0, PoolWatermarks{ 2, 4 } };
+
+    // A spike of 10 slabs worth of blocks...
+    constexpr auto spike = 10 * pool_type::blocks_per_slab;
+    std::vector<void*> blocks;
+    for( auto i = 0u; i < spike; ++i ) blocks.push_back( pool.get() );
+    EXPECT_EQ( pool.slabs(), 10u );
+
+    // ... goes back to the arena once it is over: crossing the high watermark
+    // trims free slabs down to the low one.
+    for( auto p : blocks ) pool.put( p );
+    EXPECT_EQ( pool.inUse(), 0u );
+    EXPECT_LE( pool.freeSlabs(), 4u );
+
+    EXPECT_EQ( pool.trim(), pool.slabs() );
+    EXPECT_EQ( pool.slabs(), 0u );
+
+    // With the default arena, their pages go back to the system unless they
+    // come from reserved huge pages.
+    auto arena = getPoolArena().stats();
+    if( arena.huge_tlb_bytes < arena.mapped_bytes ) {
+        EXPECT_GT( arena.released_bytes, 0u );
+    }
+
+    // Pools served through magazines are reclaimed through their depot.
+    struct FlowContext { char state_[ 3000 ]; };
+    setPoolWatermarks<FlowContext>( PoolWatermarks{ 0, 1000 } );
+    blocks.clear();
+    for( auto i = 0u; i < 1000; ++i ) blocks.push_back( getFromPool<sizeof(FlowContext)>() );
+    for( auto p : blocks ) putToPool<sizeof(FlowContext)>( p );
+
+    auto slabs = [] { return getPoolInstanceFor<FlowContext>().withSlab([](auto&& slab) { return slab.slabs(); }); };
+    auto before = slabs();
+    EXPECT_GT( reclaimPools(), 0u );
+    EXPECT_LT( slabs(), before );
+}
+
+TEST(PoolTest, ArenaReleasesWholePages) {
+
+    using namespace reconduits;
+
+    // Small pages are given back but for the first one of the slab.
+    PoolArena small_pages{ PoolArena::Config{ false, false, PoolArena::huge_page_size } };
+    auto slab = small_pages.allocate( PoolArena::min_slab_size );
+    small_pages.release( slab, PoolArena::min_slab_size );
+    EXPECT_EQ( small_pages.stats().released_bytes, PoolArena::min_slab_size - ::sysconf( _SC_PAGESIZE ) );
+    EXPECT_EQ( small_pages.allocate( PoolArena::min_slab_size ), slab );
+
+    // Reserved huge pages are never split: small slabs keep theirs, large
+    // ones give back whole huge pages, if any. Transparent ones fall back to
+    // small pages.
+    PoolArena huge_pages{ PoolArena::Config{ true, false, 4 * PoolArena::huge_page_size } };
+    slab = huge_pages.allocate( PoolArena::min_slab_size );
+    huge_pages.release( slab, PoolArena::min_slab_size );
+    auto huge_tlb = huge_pages.stats().huge_tlb_bytes != 0;
+    EXPECT_EQ( huge_pages.stats().released_bytes, huge_tlb ? 0u : PoolArena::min_slab_size - ::sysconf( _SC_PAGESIZE ) );
+    auto released = huge_pages.stats().released_bytes;
+
+    auto large = 2 * PoolArena::huge_page_size;
+    slab = huge_pages.allocate( large );
+    huge_pages.release( slab, large );
+    if( huge_tlb ) {
+        EXPECT_LE( huge_pages.stats().released_bytes, PoolArena::huge_page_size );
+        EXPECT_EQ( huge_pages.stats().released_bytes % PoolArena::huge_page_size, 0u );
+    } else {
+        EXPECT_EQ( huge_pages.stats().released_bytes - released, large - ::sysconf( _SC_PAGESIZE ) );
+    }
+    EXPECT_EQ( huge_pages.stats().slabs_free, 2u );
+}
+
+TEST(PoolTest, PoolMemoryResource) {
+
+    using namespace reconduits;
+
+    for( auto size = 1u; size <= pool_resource_max_size; ++size ) {
+        ASSERT_EQ( sizeClassAt( sizeClassIndexOf( size ) ), sizeClassOf( size ) );
+    }
+
+    auto resource = getPoolResource();
+    for( auto alignment : { 8u, 16u, 64u, 256u } ) {
+        auto p = resource->allocate( 100, alignment );
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>( p ) % alignment, 0u );
+        resource->deallocate( p, 100, alignment );
+    }
+    auto large = resource->allocate( 2 * pool_resource_max_size );
+    resource->deallocate( large, 2 * pool_resource_max_size );
+
+    GraphResource graph;
+    std::pmr::vector<std::pmr::string> names{ &graph };
+    {
+        MonotonicArena arena;
+        std::pmr::vector<int> scratch{ &arena };
+        for( auto i = 0; i < 1000; ++i ) scratch.push_back( i );
+        EXPECT_EQ( scratch.back(), 999 );
+    }
+    names.emplace_back( "a conduit with a name long enough to leave the small string buffer" );
+    EXPECT_EQ( names.get_allocator().resource(), &graph );
+}